@@ -0,0 +1,715 @@
+//
+//  bench_queue.cc
+//
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdarg>
+#include <cassert>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <chrono>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <string>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+extern void log_debug(const char* fmt, ...);
+
+#include "rdtsc.h"
+#include "queue_atomic.h"
+#include "queue_std_mutex.h"
+
+using namespace std::chrono;
+
+typedef unsigned long long u64;
+
+
+void log_debug(const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "debug: ");
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+}
+
+
+/*
+ * bench_options
+ *
+ * producers and consumers accept comma separated lists and the benchmark
+ * runs the cross product, so one invocation can sweep a scaling curve.
+ */
+
+enum bench_format { bench_format_text, bench_format_csv, bench_format_json };
+enum bench_mode { bench_mode_throughput, bench_mode_latency };
+
+struct bench_options
+{
+    std::string queue;
+    std::vector<size_t> producers;
+    std::vector<size_t> consumers;
+    size_t capacity;
+    size_t payload;
+    u64 ops;
+    u64 duration_ms;
+    size_t runs;
+    std::vector<int> cpus;
+    bool pin;
+    bench_format format;
+    bench_mode mode;
+    
+    bench_options() : queue("atomic"), producers(1, 1), consumers(1, 1), capacity(65536), payload(8),
+        ops(1 << 22), duration_ms(0), runs(3), pin(false), format(bench_format_text),
+        mode(bench_mode_throughput) {}
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  --queue=NAME        mutex, atomic, atomic:spsc, atomic:mpsc, atomic:spmc, atomic:futex, seq (default atomic)\n"
+        "  --producers=N[,N]   producer thread counts (default 1)\n"
+        "  --consumers=N[,N]   consumer thread counts (default 1)\n"
+        "  --capacity=N        queue capacity, power of 2 (default 65536)\n"
+        "  --payload=BYTES     item size: 8, 16, 32, 64, 128, 256, 512 or 1024 (default 8)\n"
+        "  --ops=N             items transferred per run (default 4194304)\n"
+        "  --duration=MS       run for a fixed time instead of a fixed item count\n"
+        "  --runs=N            runs per configuration on the same threads (default 3)\n"
+        "  --pin[=CPU,CPU]     pin threads to cpus (round robin over all cpus if no list)\n"
+        "  --format=FORMAT     text, csv or json (default text)\n"
+        "  --mode=MODE         throughput, or latency for a two thread ping-pong over two\n"
+        "                      queues reporting round-trip and one-way percentiles (ops = messages)\n",
+        prog);
+}
+
+static std::vector<size_t> parse_list(const char *arg)
+{
+    std::vector<size_t> list;
+    const char *p = arg;
+    while (*p) {
+        char *end;
+        list.push_back(strtoull(p, &end, 10));
+        if (end == p) break;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return list;
+}
+
+static bool parse_options(bench_options &opts, int argc, const char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i], name = arg, value;
+        size_t eq = arg.find('=');
+        if (eq != std::string::npos) {
+            name = arg.substr(0, eq);
+            value = arg.substr(eq + 1);
+        } else if (name != "--pin" && name != "--help" && i + 1 < argc) {
+            value = argv[++i];
+        }
+        if (name == "--queue") opts.queue = value;
+        else if (name == "--producers") opts.producers = parse_list(value.c_str());
+        else if (name == "--consumers") opts.consumers = parse_list(value.c_str());
+        else if (name == "--capacity") opts.capacity = strtoull(value.c_str(), nullptr, 10);
+        else if (name == "--payload") opts.payload = strtoull(value.c_str(), nullptr, 10);
+        else if (name == "--ops") opts.ops = strtoull(value.c_str(), nullptr, 10);
+        else if (name == "--duration") opts.duration_ms = strtoull(value.c_str(), nullptr, 10);
+        else if (name == "--runs") opts.runs = strtoull(value.c_str(), nullptr, 10);
+        else if (name == "--pin") {
+            opts.pin = true;
+            for (size_t cpu : parse_list(value.c_str())) opts.cpus.push_back((int)cpu);
+        }
+        else if (name == "--format") {
+            if (value == "text") opts.format = bench_format_text;
+            else if (value == "csv") opts.format = bench_format_csv;
+            else if (value == "json") opts.format = bench_format_json;
+            else return false;
+        }
+        else if (name == "--mode") {
+            if (value == "throughput") opts.mode = bench_mode_throughput;
+            else if (value == "latency") opts.mode = bench_mode_latency;
+            else return false;
+        }
+        else return false;
+    }
+    if (opts.producers.empty() || opts.consumers.empty() || opts.runs == 0) return false;
+    if (!opts.capacity || (opts.capacity & (opts.capacity - 1))) return false;
+    if (opts.mode == bench_mode_latency) {
+        opts.producers.assign(1, 1);
+        opts.consumers.assign(1, 1);
+        if (opts.duration_ms || opts.ops < 2) return false;
+    }
+    return true;
+}
+
+
+/*
+ * bench_barrier
+ *
+ * sense reversing spin barrier so long-lived threads start each run together
+ * and thread creation stays out of the timed region.
+ */
+
+struct bench_barrier
+{
+    const size_t count;
+    std::atomic<size_t> waiting;
+    std::atomic<size_t> generation;
+    
+    bench_barrier(size_t count) : count(count), waiting(0), generation(0) {}
+    
+    void wait()
+    {
+        size_t gen = generation.load(std::memory_order_acquire);
+        if (waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+            waiting.store(0, std::memory_order_relaxed);
+            generation.store(gen + 1, std::memory_order_release);
+        } else {
+            int spin_count = 0;
+            while (generation.load(std::memory_order_acquire) == gen) {
+                if (++spin_count < 1024) queue_cpu_relax();
+                else std::this_thread::yield();
+            }
+        }
+    }
+};
+
+static void pin_thread(std::thread &thread, const bench_options &opts, size_t index)
+{
+#if defined(__linux__)
+    if (!opts.pin) return;
+    int ncpus = (int)std::thread::hardware_concurrency();
+    int cpu = opts.cpus.empty() ? (int)(index % (ncpus ? ncpus : 1)) : opts.cpus[index % opts.cpus.size()];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "warning: could not pin thread %zu to cpu %d\n", index, cpu);
+    }
+#endif
+}
+
+
+/*
+ * bench_payload
+ *
+ * item of N bytes; the sequence number is checked by summing on both sides
+ */
+
+template <size_t N>
+struct bench_payload
+{
+    u64 seq;
+    char pad[N - sizeof(u64)];
+    
+    bench_payload() : seq(0) {}
+    bench_payload(u64 seq) : seq(seq) {}
+};
+
+template <typename T> static inline u64 payload_seq(const T &item) { return item.seq; }
+template <> inline u64 payload_seq<u64>(const u64 &item) { return item; }
+
+template <typename T> static inline T make_payload(u64 seq) { return T(seq); }
+
+
+/*
+ * bench_runner
+ *
+ * producers push their share of the items (or push until the duration
+ * expires) and consumers pop until every producer is done and the queue
+ * is drained. the threads live for all runs of a configuration.
+ */
+
+struct bench_result
+{
+    size_t run;
+    u64 items;
+    u64 time_ns;
+};
+
+template <typename item_type, typename queue_type>
+struct bench_runner
+{
+    const bench_options &opts;
+    const size_t num_producers;
+    const size_t num_consumers;
+    queue_type queue;
+    bench_barrier start_barrier;
+    bench_barrier end_barrier;
+    std::atomic<bool> stop;
+    std::atomic<bool> quit;
+    std::atomic<size_t> producers_done;
+    std::atomic<u64> pushed_sum;
+    std::atomic<u64> popped_sum;
+    std::atomic<u64> popped_count;
+    std::vector<std::thread> threads;
+    
+    bench_runner(const bench_options &opts, size_t num_producers, size_t num_consumers)
+        : opts(opts), num_producers(num_producers), num_consumers(num_consumers), queue(opts.capacity),
+          start_barrier(num_producers + num_consumers + 1), end_barrier(num_producers + num_consumers + 1),
+          stop(false), quit(false), producers_done(0), pushed_sum(0), popped_sum(0), popped_count(0)
+    {
+        for (size_t p = 0; p < num_producers; p++) {
+            threads.push_back(std::thread(&bench_runner::producer, this, p));
+            pin_thread(threads.back(), opts, threads.size() - 1);
+        }
+        for (size_t c = 0; c < num_consumers; c++) {
+            threads.push_back(std::thread(&bench_runner::consumer, this));
+            pin_thread(threads.back(), opts, threads.size() - 1);
+        }
+    }
+    
+    ~bench_runner()
+    {
+        quit.store(true, std::memory_order_relaxed);
+        start_barrier.wait();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+    
+    void producer(size_t p)
+    {
+        for (;;) {
+            start_barrier.wait();
+            if (quit.load(std::memory_order_relaxed)) return;
+    
+            u64 quota = opts.duration_ms ? ~0ULL : opts.ops / num_producers + (p < opts.ops % num_producers);
+            u64 sum = 0;
+            for (u64 i = 0; i < quota; i++) {
+                u64 seq = ((u64)p << 40) | (i + 1);
+                item_type item = make_payload<item_type>(seq);
+                bool pushed;
+                while (!(pushed = queue.push_back(item))) {
+                    if (stop.load(std::memory_order_relaxed)) break;
+                    std::this_thread::yield();
+                }
+                if (pushed) sum += seq;
+                if (!pushed || stop.load(std::memory_order_relaxed)) break;
+            }
+            pushed_sum.fetch_add(sum, std::memory_order_relaxed);
+            producers_done.fetch_add(1, std::memory_order_release);
+    
+            end_barrier.wait();
+        }
+    }
+    
+    void consumer()
+    {
+        for (;;) {
+            start_barrier.wait();
+            if (quit.load(std::memory_order_relaxed)) return;
+    
+            u64 sum = 0, count = 0;
+            item_type item = item_type();
+            for (;;) {
+                if (queue.try_pop(item) == queue_ok) {
+                    sum += payload_seq(item);
+                    count++;
+                } else if (producers_done.load(std::memory_order_acquire) == num_producers) {
+                    /* producers are done, drain anything published before they finished */
+                    while (queue.try_pop(item) == queue_ok) {
+                        sum += payload_seq(item);
+                        count++;
+                    }
+                    break;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            popped_sum.fetch_add(sum, std::memory_order_relaxed);
+            popped_count.fetch_add(count, std::memory_order_relaxed);
+    
+            end_barrier.wait();
+        }
+    }
+    
+    bench_result run(size_t run)
+    {
+        stop.store(false, std::memory_order_relaxed);
+        producers_done.store(0, std::memory_order_relaxed);
+        pushed_sum.store(0, std::memory_order_relaxed);
+        popped_sum.store(0, std::memory_order_relaxed);
+        popped_count.store(0, std::memory_order_relaxed);
+    
+        start_barrier.wait();
+        const auto t1 = steady_clock::now();
+        if (opts.duration_ms) {
+            std::this_thread::sleep_for(milliseconds(opts.duration_ms));
+            stop.store(true, std::memory_order_relaxed);
+        }
+        end_barrier.wait();
+        const auto t2 = steady_clock::now();
+    
+        if (pushed_sum.load() != popped_sum.load()) {
+            fprintf(stderr, "error: %s pushed and popped items differ\n", opts.queue.c_str());
+            exit(1);
+        }
+    
+        bench_result result;
+        result.run = run;
+        result.items = popped_count.load();
+        result.time_ns = duration_cast<nanoseconds>(t2 - t1).count();
+        return result;
+    }
+};
+
+/*
+ * bench_histogram
+ *
+ * HDR style log-linear histogram: values below 2^sub_bits are exact and each
+ * power of two above is split into 2^sub_bits buckets, so a recorded value is
+ * within 1/32 (about 3%) of the reported value.
+ */
+
+struct bench_histogram
+{
+    static const int sub_bits =                 5;
+    static const int sub_count =                1 << sub_bits;
+    static const int bucket_count =             (64 - sub_bits + 1) * sub_count;
+    
+    std::vector<u64> counts;
+    u64 total;
+    u64 sum;
+    u64 max;
+    
+    bench_histogram() : counts(bucket_count), total(0), sum(0), max(0) {}
+    
+    static inline size_t index(u64 val)
+    {
+        if (val < (u64)sub_count) return (size_t)val;
+        int msb = 63 - __builtin_clzll(val);
+        int shift = msb - sub_bits;
+        return (size_t)(shift + 1) * sub_count + (size_t)((val >> shift) - sub_count);
+    }
+    
+    /* highest value that maps to the bucket */
+    static inline u64 highest_value(size_t idx)
+    {
+        if (idx < (size_t)sub_count) return idx;
+        int shift = (int)(idx / sub_count) - 1;
+        u64 sub = idx % sub_count;
+        return ((sub_count + sub + 1) << shift) - 1;
+    }
+    
+    inline void record(u64 val)
+    {
+        counts[index(val)]++;
+        total++;
+        sum += val;
+        if (val > max) max = val;
+    }
+    
+    u64 percentile(double pct) const
+    {
+        u64 target = (u64)(pct / 100.0 * (double)total), seen = 0;
+        for (size_t idx = 0; idx < counts.size(); idx++) {
+            seen += counts[idx];
+            if (seen > target) return std::min(highest_value(idx), max);
+        }
+        return max;
+    }
+};
+
+
+/*
+ * bench_latency
+ *
+ * two pinned threads and two queues: the pinger stamps each message with the
+ * counter and pushes it to the ping queue, the ponger records the one-way
+ * latency and pushes the message back on the pong queue, and the pinger
+ * records the round trip. the first ops/16 messages warm up and are discarded.
+ */
+
+/*
+ * latency clock: the serialized, calibrated counter from rdtsc.h where the
+ * target has one (x86_64, aarch64), otherwise steady_clock nanoseconds
+ */
+
+#if RDTSC_HAS_SERIALIZED
+static const char *bench_clock_name = "tsc";
+static inline u64 bench_clock_begin() { return rdtsc_begin(); }
+static inline u64 bench_clock_end() { return rdtsc_end(); }
+static inline double bench_clock_ticks_per_ns() { return rdtsc_ticks_per_ns(); }
+#else
+static const char *bench_clock_name = "steady_clock";
+static inline u64 bench_clock_begin()
+{
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+static inline u64 bench_clock_end() { return bench_clock_begin(); }
+static inline double bench_clock_ticks_per_ns() { return 1.0; }
+#endif
+
+static inline double bench_clock_to_ns(u64 ticks) { return (double)ticks / bench_clock_ticks_per_ns(); }
+
+template <typename queue_type, typename item_type>
+static inline item_type bench_pop_spin(queue_type &queue)
+{
+    item_type item = item_type();
+    int spin_count = 0;
+    while (queue.try_pop(item) != queue_ok) {
+        if (++spin_count < 4096) queue_cpu_relax();
+        else std::this_thread::yield();
+    }
+    return item;
+}
+
+template <typename queue_type, typename item_type>
+static inline void bench_push_spin(queue_type &queue, const item_type &item)
+{
+    while (!queue.push_back(item)) queue_cpu_relax();
+}
+
+static void print_latency(const bench_options &opts, const char *metric, const bench_histogram &h);
+
+template <typename item_type, typename queue_type>
+static void bench_latency(const bench_options &opts)
+{
+    queue_type ping(opts.capacity), pong(opts.capacity);
+    bench_histogram round_trip, one_way;
+    bench_barrier start_barrier(2);
+    const u64 warmup = opts.ops / 16;
+    const u64 count = opts.ops + warmup;
+    
+    bench_clock_ticks_per_ns();
+    
+    std::thread ponger([&] {
+        start_barrier.wait();
+        for (u64 i = 0; i < count; i++) {
+            item_type item = bench_pop_spin<queue_type,item_type>(ping);
+            u64 t = bench_clock_end();
+            if (i >= warmup) one_way.record(t - payload_seq(item));
+            bench_push_spin(pong, item);
+        }
+    });
+    pin_thread(ponger, opts, 1);
+    
+    std::thread pinger([&] {
+        start_barrier.wait();
+        for (u64 i = 0; i < count; i++) {
+            u64 t1 = bench_clock_begin();
+            bench_push_spin(ping, make_payload<item_type>(t1));
+            bench_pop_spin<queue_type,item_type>(pong);
+            u64 t2 = bench_clock_end();
+            if (i >= warmup) round_trip.record(t2 - t1);
+        }
+    });
+    pin_thread(pinger, opts, 0);
+    
+    pinger.join();
+    ponger.join();
+    
+    print_latency(opts, "rtt", round_trip);
+    print_latency(opts, "oneway", one_way);
+}
+
+
+/* output */
+
+static size_t result_count = 0;
+
+static void print_header(const bench_options &opts)
+{
+    switch (opts.format) {
+    case bench_format_text:
+        printf("%-20s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-12s %-9s\n",
+               "name", "payload", "producer", "consumer", "capacity", "run",
+               "items", "time(us)", "ops/s", "op(ns)");
+        break;
+    case bench_format_csv:
+        printf("queue,payload,producers,consumers,capacity,pinned,run,items,time_us,ops_per_sec,ns_per_op\n");
+        break;
+    case bench_format_json:
+        printf("[\n");
+        break;
+    }
+}
+
+static void print_result(const bench_options &opts, size_t producers, size_t consumers, const bench_result &r)
+{
+    double ops_per_sec = r.time_ns ? (double)r.items * 1e9 / (double)r.time_ns : 0;
+    double ns_per_op = r.items ? (double)r.time_ns / (double)r.items : 0;
+    
+    switch (opts.format) {
+    case bench_format_text:
+        printf("%-20s %-9zu %-9zu %-9zu %-9zu %-9zu %-9llu %-9llu %-12.0lf %-9.3lf\n",
+               opts.queue.c_str(), opts.payload, producers, consumers, opts.capacity, r.run,
+               (u64)r.items, (u64)(r.time_ns / 1000), ops_per_sec, ns_per_op);
+        break;
+    case bench_format_csv:
+        printf("%s,%zu,%zu,%zu,%zu,%d,%zu,%llu,%llu,%.0lf,%.3lf\n",
+               opts.queue.c_str(), opts.payload, producers, consumers, opts.capacity, opts.pin, r.run,
+               (u64)r.items, (u64)(r.time_ns / 1000), ops_per_sec, ns_per_op);
+        break;
+    case bench_format_json:
+        printf("%s  {\"queue\": \"%s\", \"payload\": %zu, \"producers\": %zu, \"consumers\": %zu, "
+               "\"capacity\": %zu, \"pinned\": %s, \"run\": %zu, \"items\": %llu, \"time_us\": %llu, "
+               "\"ops_per_sec\": %.0lf, \"ns_per_op\": %.3lf}",
+               result_count ? ",\n" : "", opts.queue.c_str(), opts.payload, producers, consumers,
+               opts.capacity, opts.pin ? "true" : "false", r.run,
+               (u64)r.items, (u64)(r.time_ns / 1000), ops_per_sec, ns_per_op);
+        break;
+    }
+    result_count++;
+    fflush(stdout);
+}
+
+static void print_latency_header(const bench_options &opts)
+{
+    switch (opts.format) {
+    case bench_format_text:
+        printf("# %s ticks/ns = %.4lf\n", bench_clock_name, bench_clock_ticks_per_ns());
+        printf("%-20s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s\n",
+               "name", "payload", "metric", "count", "mean(ns)", "p50(ns)", "p99(ns)", "p99.9(ns)", "max(ns)");
+        break;
+    case bench_format_csv:
+        printf("queue,payload,pinned,metric,count,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+        break;
+    case bench_format_json:
+        printf("[\n");
+        break;
+    }
+}
+
+static void print_latency(const bench_options &opts, const char *metric, const bench_histogram &h)
+{
+    double mean = h.total ? bench_clock_to_ns(h.sum) / (double)h.total : 0;
+    double p50 = bench_clock_to_ns(h.percentile(50)), p99 = bench_clock_to_ns(h.percentile(99));
+    double p999 = bench_clock_to_ns(h.percentile(99.9)), max = bench_clock_to_ns(h.max);
+    
+    switch (opts.format) {
+    case bench_format_text:
+        printf("%-20s %-9zu %-9s %-9llu %-9.1lf %-9.1lf %-9.1lf %-9.1lf %-9.1lf\n",
+               opts.queue.c_str(), opts.payload, metric, (u64)h.total, mean, p50, p99, p999, max);
+        break;
+    case bench_format_csv:
+        printf("%s,%zu,%d,%s,%llu,%.1lf,%.1lf,%.1lf,%.1lf,%.1lf\n",
+               opts.queue.c_str(), opts.payload, opts.pin, metric, (u64)h.total, mean, p50, p99, p999, max);
+        break;
+    case bench_format_json:
+        printf("%s  {\"queue\": \"%s\", \"payload\": %zu, \"pinned\": %s, \"metric\": \"%s\", "
+               "\"count\": %llu, \"mean_ns\": %.1lf, \"p50_ns\": %.1lf, \"p99_ns\": %.1lf, "
+               "\"p999_ns\": %.1lf, \"max_ns\": %.1lf}",
+               result_count ? ",\n" : "", opts.queue.c_str(), opts.payload, opts.pin ? "true" : "false",
+               metric, (u64)h.total, mean, p50, p99, p999, max);
+        break;
+    }
+    result_count++;
+    fflush(stdout);
+}
+
+static void print_footer(const bench_options &opts)
+{
+    if (opts.format == bench_format_json) printf("%s]\n", result_count ? "\n" : "");
+}
+
+
+/* queue selection */
+
+template <typename item_type, typename queue_type>
+static void bench_configuration(const bench_options &opts, size_t producers, size_t consumers)
+{
+    if (opts.mode == bench_mode_latency) {
+        bench_latency<item_type,queue_type>(opts);
+        return;
+    }
+    
+    bench_runner<item_type,queue_type> runner(opts, producers, consumers);
+    for (size_t run = 0; run < opts.runs; run++) {
+        print_result(opts, producers, consumers, runner.run(run));
+    }
+}
+
+template <typename item_type, template <typename> class Storage>
+static bool bench_queue_type(const bench_options &opts, size_t producers, size_t consumers)
+{
+    typedef queue_atomic<item_type,false,uint64_t,48,16,
+        std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+        queue_notify_none,queue_backoff_spin_yield<>,queue_mpmc,Storage> atomic_type;
+    typedef queue_atomic<item_type,false,uint64_t,48,16,
+        std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+        queue_notify_futex,queue_backoff_spin_yield<>,queue_mpmc,Storage> atomic_futex_type;
+    typedef queue_atomic<item_type,false,uint64_t,48,16,
+        std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+        queue_notify_none,queue_backoff_spin_yield<>,queue_spsc,Storage> atomic_spsc_type;
+    typedef queue_atomic<item_type,false,uint64_t,48,16,
+        std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+        queue_notify_none,queue_backoff_spin_yield<>,queue_mpsc,Storage> atomic_mpsc_type;
+    typedef queue_atomic<item_type,false,uint64_t,48,16,
+        std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+        queue_notify_none,queue_backoff_spin_yield<>,queue_spmc,Storage> atomic_spmc_type;
+    
+    if (opts.queue == "mutex") {
+        bench_configuration<item_type,queue_std_mutex<item_type>>(opts, producers, consumers);
+    } else if (opts.queue == "atomic") {
+        bench_configuration<item_type,atomic_type>(opts, producers, consumers);
+    } else if (opts.queue == "atomic:futex") {
+        bench_configuration<item_type,atomic_futex_type>(opts, producers, consumers);
+    } else if (opts.queue == "atomic:spsc" && producers == 1 && consumers == 1) {
+        bench_configuration<item_type,atomic_spsc_type>(opts, producers, consumers);
+    } else if (opts.queue == "atomic:mpsc" && consumers == 1) {
+        bench_configuration<item_type,atomic_mpsc_type>(opts, producers, consumers);
+    } else if (opts.queue == "atomic:spmc" && producers == 1) {
+        bench_configuration<item_type,atomic_spmc_type>(opts, producers, consumers);
+    } else if (opts.queue == "seq") {
+        bench_configuration<item_type,queue_atomic_seq<item_type>>(opts, producers, consumers);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool bench_payload_size(const bench_options &opts, size_t producers, size_t consumers)
+{
+    switch (opts.payload) {
+    case 8:    return bench_queue_type<u64,queue_storage_atomic>(opts, producers, consumers);
+    case 16:   return bench_queue_type<bench_payload<16>,queue_storage_inline>(opts, producers, consumers);
+    case 32:   return bench_queue_type<bench_payload<32>,queue_storage_inline>(opts, producers, consumers);
+    case 64:   return bench_queue_type<bench_payload<64>,queue_storage_inline>(opts, producers, consumers);
+    case 128:  return bench_queue_type<bench_payload<128>,queue_storage_inline>(opts, producers, consumers);
+    case 256:  return bench_queue_type<bench_payload<256>,queue_storage_inline>(opts, producers, consumers);
+    case 512:  return bench_queue_type<bench_payload<512>,queue_storage_inline>(opts, producers, consumers);
+    case 1024: return bench_queue_type<bench_payload<1024>,queue_storage_inline>(opts, producers, consumers);
+    default:   return false;
+    }
+}
+
+int main(int argc, const char * argv[])
+{
+    bench_options opts;
+    if (!parse_options(opts, argc, argv)) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    if (opts.mode == bench_mode_latency) print_latency_header(opts);
+    else print_header(opts);
+    for (size_t producers : opts.producers) {
+        for (size_t consumers : opts.consumers) {
+            if (!bench_payload_size(opts, producers, consumers)) {
+                print_footer(opts);
+                fprintf(stderr, "error: unsupported queue %s with payload %zu, %zu producers and %zu consumers\n",
+                        opts.queue.c_str(), opts.payload, producers, consumers);
+                return 1;
+            }
+        }
+    }
+    print_footer(opts);
+    return 0;
+}
@@ -20,320 +20,2287 @@
  *   - pop_front reads 3 atomics: counter_front, version_back and version_front
  *               writes 2 atomics: counter_front and version_front
  *
+ *   - a single producer or single consumer side (see Cardinality) has no counter:
+ *     its push_back or pop_front only touches version_back and version_front
+ *
  *   - back version and front version are packed into version_back and version_front
  *
- *   - version is used for conflict detection during ordered writes
+ *   - version is used for conflict detection during ordered writes
+ *
+ *   - push_back_n and pop_front_n claim a contiguous range of slots with one
+ *     compare_exchange and publish the new version once for the whole range
+ *
+ *   - push_back_wait and pop_front_wait park on version_front and version_back
+ *     using the Notify policy (queue_notify_none yields, queue_notify_futex parks,
+ *     queue_notify_eventfd signals an eventfd an epoll loop can wait on)
+ *
+ *   - the Backoff policy is applied after each phase 1 or phase 2 failure
+ *     (default queue_backoff_spin_yield spins 8 times then yields)
+ *
+ *   - the Layout policy maps offsets to slots: linear (default), rotated so
+ *     adjacent offsets use different cache lines, or padded to a cache line
+ *     per slot, which keeps a producer and consumer of a nearly empty queue
+ *     off each other's cache line
+ *
+ *   - the Overflow policy selects rejecting pushes onto a full queue
+ *     (queue_overflow_reject) or dropping the oldest item to make room
+ *     (queue_overflow_overwrite) with a dropped item count
+ *
+ *   - the Stats policy counts attempts, failures and retries per thread with
+ *     log2 histograms of retries and cycles per claim (queue_stats_thread);
+ *     queue_stats_none (default) compiles to nothing
+ *
+ *   - the Cardinality policy (queue_mpmc, queue_mpsc, queue_spmc, queue_spsc)
+ *     removes the counter and its compare_exchange on a single threaded side
+ *
+ *   - reserve_back/commit and peek_front/release expose the claimed slots for
+ *     in-place writes and reads, and consume_all drains the queue through a
+ *     callback on at most two contiguous runs; the Storage policy selects std::atomic<T>
+ *     slots (queue_storage_atomic), plain T slots (queue_storage_raw) or
+ *     cache line aligned memcpy slots for large payloads (queue_storage_inline)
+ *
+ */
+
+#if defined(_MSC_VER)
+#define ALIGNED(x) __declspec(align(x))
+#elif defined(__GNUC__)
+#define ALIGNED(x) __attribute__((aligned(x)))
+#else
+#define ALIGNED(x)
+#endif
+
+/*
+ * queue_aligned_new / queue_aligned_delete - heap objects with ALIGNED(64)
+ * members; before C++17 plain new only guarantees alignof(max_align_t).
+ * queue_aligned_new_n / queue_aligned_delete_n construct and destroy an array.
+ */
+
+template <typename T>
+void* queue_aligned_alloc(size_t n)
+{
+    const size_t align = alignof(T) < sizeof(void*) ? sizeof(void*) : alignof(T);
+    void *mem;
+#if defined(_MSC_VER)
+    mem = _aligned_malloc(n * sizeof(T), align);
+#else
+    if (posix_memalign(&mem, align, n * sizeof(T))) mem = nullptr;
+#endif
+    assert(mem != nullptr);
+    return mem;
+}
+
+inline void queue_aligned_free(void *mem)
+{
+#if defined(_MSC_VER)
+    _aligned_free(mem);
+#else
+    free(mem);
+#endif
+}
+
+template <typename T, typename... Args>
+T* queue_aligned_new(Args&&... args)
+{
+    return new (queue_aligned_alloc<T>(1)) T(std::forward<Args>(args)...);
+}
+
+template <typename T>
+void queue_aligned_delete(T *ptr)
+{
+    if (!ptr) return;
+    ptr->~T();
+    queue_aligned_free(ptr);
+}
+
+template <typename T>
+T* queue_aligned_new_n(size_t n)
+{
+    T *vec = static_cast<T*>(queue_aligned_alloc<T>(n));
+    for (size_t i = 0; i < n; i++) new (vec + i) T();
+    return vec;
+}
+
+template <typename T>
+void queue_aligned_delete_n(T *vec, size_t n)
+{
+    if (!vec) return;
+    for (size_t i = 0; i < n; i++) vec[i].~T();
+    queue_aligned_free(vec);
+}
+
+/*
+ * queue_atomic_word
+ *
+ * maps the queue ATOMIC_UINT to the atomic type used for the counter and version
+ * words. std::atomic for native widths; queue_atomic_u128 for queue_uint128_t,
+ * which uses a double-width compare_exchange (cmpxchg16b on x86-64 and casp or
+ * ldaxp/stlxp on aarch64) so it does not fall back to the libatomic lock table.
+ */
+
+template <typename ATOMIC_UINT>
+struct queue_atomic_word
+{
+    typedef std::atomic<ATOMIC_UINT> type;
+};
+
+#if defined(__SIZEOF_INT128__) && (defined(__x86_64__) || defined(__aarch64__)) && \
+    defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+#define QUEUE_HAS_UINT128 1
+
+typedef unsigned __int128 queue_uint128_t;
+
+/*
+ * queue_atomic_u128
+ *
+ *   - compare_exchange is a single double-width atomic instruction
+ *
+ *   - load is two ordered 64-bit loads (hi then lo) and may observe a torn value
+ *     while a store is in flight; the queue only trusts a whole-word load after
+ *     validating it with compare_exchange and otherwise reads the lo half alone
+ *
+ *   - store is two ordered 64-bit stores (lo then hi) so a reader that sees the
+ *     new hi half also sees the new lo half
+ */
+
+struct ALIGNED(16) queue_atomic_u128
+{
+    typedef queue_uint128_t value_type;
+    
+    std::atomic<uint64_t> lo;
+    std::atomic<uint64_t> hi;
+    
+    queue_atomic_u128(value_type val = 0) : lo((uint64_t)val), hi((uint64_t)(val >> 64)) {}
+    
+    bool is_lock_free() const { return true; }
+    
+    value_type load(std::memory_order order = std::memory_order_seq_cst) const
+    {
+        uint64_t _hi = hi.load(order == std::memory_order_relaxed ? order : std::memory_order_acquire);
+        uint64_t _lo = lo.load(order == std::memory_order_relaxed ? order : std::memory_order_acquire);
+        return ((value_type)_hi << 64) | _lo;
+    }
+    
+    void store(value_type val, std::memory_order order = std::memory_order_seq_cst)
+    {
+        lo.store((uint64_t)val, order);
+        hi.store((uint64_t)(val >> 64), order);
+    }
+    
+    operator value_type() const { return load(); }
+    
+    bool compare_exchange_weak(value_type &expected, value_type desired,
+                               std::memory_order order = std::memory_order_seq_cst)
+    {
+        return compare_exchange_strong(expected, desired, order);
+    }
+    
+    bool compare_exchange_strong(value_type &expected, value_type desired,
+                                 std::memory_order = std::memory_order_seq_cst)
+    {
+        uint64_t exp_lo = (uint64_t)expected, exp_hi = (uint64_t)(expected >> 64);
+        uint64_t des_lo = (uint64_t)desired, des_hi = (uint64_t)(desired >> 64);
+        bool result;
+#if defined(__x86_64__)
+        __asm__ __volatile__ ("lock cmpxchg16b %1\n\tsetz %0"
+                              : "=q"(result), "+m"(*(volatile queue_uint128_t*)this),
+                                "+a"(exp_lo), "+d"(exp_hi)
+                              : "b"(des_lo), "c"(des_hi)
+                              : "cc", "memory");
+#elif defined(__ARM_FEATURE_ATOMICS)
+        register uint64_t x0 __asm__("x0") = exp_lo;
+        register uint64_t x1 __asm__("x1") = exp_hi;
+        register uint64_t x2 __asm__("x2") = des_lo;
+        register uint64_t x3 __asm__("x3") = des_hi;
+        __asm__ __volatile__ ("caspal %0, %1, %2, %3, %4"
+                              : "+r"(x0), "+r"(x1)
+                              : "r"(x2), "r"(x3), "Q"(*(volatile queue_uint128_t*)this)
+                              : "memory");
+        result = (x0 == exp_lo && x1 == exp_hi);
+        exp_lo = x0;
+        exp_hi = x1;
+#else
+        uint64_t old_lo, old_hi;
+        uint32_t fail;
+        do {
+            __asm__ __volatile__ ("ldaxp %0, %1, %2"
+                                  : "=&r"(old_lo), "=&r"(old_hi)
+                                  : "Q"(*(volatile queue_uint128_t*)this)
+                                  : "memory");
+            if (old_lo != exp_lo || old_hi != exp_hi) {
+                __asm__ __volatile__ ("clrex" ::: "memory");
+                break;
+            }
+            __asm__ __volatile__ ("stlxp %w0, %2, %3, %1"
+                                  : "=&r"(fail), "=Q"(*(volatile queue_uint128_t*)this)
+                                  : "r"(des_lo), "r"(des_hi)
+                                  : "memory");
+        } while (fail);
+        result = (old_lo == exp_lo && old_hi == exp_hi);
+        exp_lo = old_lo;
+        exp_hi = old_hi;
+#endif
+        expected = ((value_type)exp_hi << 64) | exp_lo;
+        return result;
+    }
+};
+
+template <>
+struct queue_atomic_word<queue_uint128_t>
+{
+    typedef queue_atomic_u128 type;
+};
+
+#endif
+
+
+#if defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <linux/futex.h>
+#include <linux/mempolicy.h>
+#else
+#include <condition_variable>
+#endif
+
+
+/*
+ * queue_notify_none
+ *
+ * default notifier policy: no waiter bookkeeping on the push and pop fast path,
+ * the blocking calls fall back to yielding until the queue changes state.
+ */
+
+struct queue_notify_none
+{
+    template <typename ATOMIC, typename VALUE>
+    bool wait(ATOMIC &, VALUE, const std::chrono::steady_clock::time_point *deadline)
+    {
+        if (deadline && std::chrono::steady_clock::now() >= *deadline) return false;
+        std::this_thread::yield();
+        return true;
+    }
+    
+    template <typename ATOMIC, typename VALUE>
+    bool park(ATOMIC &word, VALUE val, const std::chrono::steady_clock::time_point *deadline)
+    {
+        return wait(word, val, deadline);
+    }
+    
+    template <typename ATOMIC>
+    void notify(ATOMIC &, size_t = 1) {}
+};
+
+
+/*
+ * queue_notify_futex
+ *
+ * parking notifier policy: waiters sleep on the low 32 bits of a packed version
+ * word (futex on linux, condition variable elsewhere) until it changes.
+ *
+ * the waiter count lets notify skip the wake syscall when nobody is parked. the
+ * waiter increments the count before re-checking the word and the notifier
+ * fences after publishing the word before reading the count, so either the
+ * waiter sees the new word or the notifier sees the waiter.
+ *
+ * notify wakes one waiter per published item (one for push_back and pop_front,
+ * n for a batch) so a single item does not wake every parked consumer. threads
+ * parked by a backoff policy (park) wait for the word to change rather than for
+ * an item, so while any is parked notify wakes everyone; they are counted in
+ * the high bits of the waiter count.
+ */
+
+struct queue_notify_futex
+{
+    /* waiters unit of a thread parked by a backoff policy */
+    static const uint32_t parker =              1 << 16;
+    
+    std::atomic<uint32_t> waiters;
+#if !defined(__linux__)
+    std::mutex wait_mutex;
+    std::condition_variable wait_cond;
+#endif
+    
+    queue_notify_futex() : waiters(0) {}
+    
+    template <typename ATOMIC>
+    static uint32_t* futex_word(ATOMIC &word)
+    {
+        static_assert(sizeof(ATOMIC) >= sizeof(uint32_t), "futex word must be at least 32 bits");
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return reinterpret_cast<uint32_t*>(&word) + (sizeof(ATOMIC) / sizeof(uint32_t) - 1);
+#else
+        return reinterpret_cast<uint32_t*>(&word);
+#endif
+    }
+    
+    /*
+     * park until word no longer holds val, the deadline passes or a spurious wakeup.
+     * returns false if the deadline had already passed on entry.
+     */
+    template <typename ATOMIC, typename VALUE>
+    bool wait(ATOMIC &word, VALUE val, const std::chrono::steady_clock::time_point *deadline)
+    {
+        return _wait(word, val, deadline, 1);
+    }
+    
+    /* wait from a backoff policy: woken by every notify */
+    template <typename ATOMIC, typename VALUE>
+    bool park(ATOMIC &word, VALUE val, const std::chrono::steady_clock::time_point *deadline)
+    {
+        return _wait(word, val, deadline, parker);
+    }
+    
+    template <typename ATOMIC, typename VALUE>
+    bool _wait(ATOMIC &word, VALUE val, const std::chrono::steady_clock::time_point *deadline, uint32_t unit)
+    {
+        using namespace std::chrono;
+        
+        nanoseconds rel(0);
+        if (deadline) {
+            rel = duration_cast<nanoseconds>(*deadline - steady_clock::now());
+            if (rel.count() <= 0) return false;
+        }
+        waiters.fetch_add(unit, std::memory_order_seq_cst);
+#if defined(__linux__)
+        if (word.load(std::memory_order_seq_cst) == val) {
+            struct timespec ts;
+            ts.tv_sec = (time_t)(rel.count() / 1000000000);
+            ts.tv_nsec = (long)(rel.count() % 1000000000);
+            syscall(SYS_futex, futex_word(word), FUTEX_WAIT_PRIVATE, (uint32_t)val,
+                    deadline ? &ts : nullptr, nullptr, 0);
+        }
+#else
+        {
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            if (word.load(std::memory_order_seq_cst) == val) {
+                if (deadline) {
+                    wait_cond.wait_until(lock, *deadline);
+                } else {
+                    wait_cond.wait(lock);
+                }
+            }
+        }
+#endif
+        waiters.fetch_sub(unit, std::memory_order_relaxed);
+        return true;
+    }
+    
+    /*
+     * wake up to count parked waiters (all if a backoff policy has parked), called
+     * after the version word has been published for count items
+     */
+    template <typename ATOMIC>
+    void notify(ATOMIC &word, size_t count = 1)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t parked = waiters.load(std::memory_order_relaxed);
+        if (parked == 0) return;
+        bool all = parked >= parker || count >= INT_MAX;
+#if defined(__linux__)
+        syscall(SYS_futex, futex_word(word), FUTEX_WAKE_PRIVATE, all ? INT_MAX : (int)count,
+                nullptr, nullptr, 0);
+#else
+        { std::lock_guard<std::mutex> lock(wait_mutex); }
+        if (all || count > 1) {
+            wait_cond.notify_all();
+        } else {
+            wait_cond.notify_one();
+        }
+#endif
+    }
+};
+
+
+/*
+ * queue_notify_eventfd
+ *
+ * readiness notifier policy for event loops (linux): owns an eventfd that can
+ * be registered with epoll through fd() and is signalled when the queue
+ * changes state, e.g. notify_back.fd() becomes readable after a push.
+ *
+ * signals are coalesced: notify writes the eventfd only while a consumer has
+ * armed interest, and the write disarms it, so a burst of pushes costs one
+ * write(). the consumer calls arm() when the fd is readable, which clears the
+ * eventfd and arms it again, and then drains the queue; arm fences before the
+ * drain reads the version word and notify fences after publishing it, so
+ * either the drain sees the item or the push sees the armed flag. the policy
+ * starts armed.
+ *
+ * with Coalesce false every notify writes the eventfd (per push signalling).
+ * wait parks in poll() on the eventfd and suits one waiting thread per side;
+ * use queue_notify_futex for several parked threads.
+ */
+
+#if defined(__linux__)
+
+template <const bool Coalesce = true>
+struct queue_notify_eventfd
+{
+    int efd;
+    std::atomic<bool> armed;
+    std::atomic<uint64_t> signals;
+    
+    queue_notify_eventfd() : efd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), armed(true), signals(0)
+    {
+        assert(efd >= 0);
+    }
+    
+    queue_notify_eventfd(const queue_notify_eventfd&) = delete;
+    queue_notify_eventfd& operator=(const queue_notify_eventfd&) = delete;
+    
+    ~queue_notify_eventfd() { close(efd); }
+    
+    int fd() const { return efd; }
+    
+    /* clear the eventfd and ask for one signal on the next notify; drain the queue after */
+    void arm()
+    {
+        uint64_t count;
+        if (read(efd, &count, sizeof(count)) < 0) { /* EAGAIN: already clear */ }
+        armed.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    
+    /*
+     * park in poll until the eventfd is signalled or the deadline passes, unless
+     * word no longer holds val once armed. returns false if the deadline had
+     * already passed on entry.
+     */
+    template <typename ATOMIC, typename VALUE>
+    bool wait(ATOMIC &word, VALUE val, const std::chrono::steady_clock::time_point *deadline)
+    {
+        using namespace std::chrono;
+        
+        int timeout = -1;
+        if (deadline) {
+            nanoseconds rel = duration_cast<nanoseconds>(*deadline - steady_clock::now());
+            if (rel.count() <= 0) return false;
+            /* round up so the poll does not return before the deadline */
+            timeout = (int)((rel.count() + 999999) / 1000000);
+        }
+        arm();
+        if (word.load(std::memory_order_seq_cst) == val) {
+            struct pollfd pfd = { efd, POLLIN, 0 };
+            poll(&pfd, 1, timeout);
+        }
+        return true;
+    }
+    
+    template <typename ATOMIC, typename VALUE>
+    bool park(ATOMIC &word, VALUE val, const std::chrono::steady_clock::time_point *deadline)
+    {
+        return wait(word, val, deadline);
+    }
+    
+    /*
+     * signal the eventfd, called after the version word has been published
+     */
+    template <typename ATOMIC>
+    void notify(ATOMIC &, size_t = 1)
+    {
+        if (Coalesce) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!armed.load(std::memory_order_relaxed) || !armed.exchange(false, std::memory_order_relaxed)) return;
+        }
+        uint64_t one = 1;
+        if (write(efd, &one, sizeof(one)) < 0) { /* EAGAIN: counter saturated, still readable */ }
+        signals.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+#endif
+
+
+/*
+ * queue_cpu_relax
+ *
+ * spin-wait hint: pause on x86, yield on arm
+ */
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+static inline void queue_cpu_relax() { _mm_pause(); }
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+static inline void queue_cpu_relax() { __asm__ __volatile__ ("pause" ::: "memory"); }
+#elif defined(__GNUC__) && (defined(__aarch64__) || defined(__arm__))
+static inline void queue_cpu_relax() { __asm__ __volatile__ ("yield" ::: "memory"); }
+#else
+static inline void queue_cpu_relax() { std::atomic_signal_fence(std::memory_order_seq_cst); }
+#endif
+
+
+/*
+ * backoff policies
+ *
+ * called from the retry loop after a phase 1 or phase 2 failure with the retry
+ * count, the notifier of the contended side and the version word value that was
+ * observed, so that a parking policy can sleep until the version word changes.
+ */
+
+/* queue_backoff_yield - yield the thread on every retry */
+
+struct queue_backoff_yield
+{
+    template <typename Notify, typename ATOMIC, typename VALUE>
+    static inline void backoff(int, Notify &, ATOMIC &, VALUE)
+    {
+        std::this_thread::yield();
+    }
+};
+
+/* queue_backoff_spin - spin with a cpu relax hint on every retry */
+
+struct queue_backoff_spin
+{
+    template <typename Notify, typename ATOMIC, typename VALUE>
+    static inline void backoff(int, Notify &, ATOMIC &, VALUE)
+    {
+        queue_cpu_relax();
+    }
+};
+
+/* queue_backoff_exponential - spin for 2^n relax hints, n bounded by max_shift */
+
+template <const int max_shift = 10>
+struct queue_backoff_exponential
+{
+    template <typename Notify, typename ATOMIC, typename VALUE>
+    static inline void backoff(int spin_count, Notify &, ATOMIC &, VALUE)
+    {
+        int count = 1 << (spin_count < max_shift ? spin_count : max_shift);
+        for (int i = 0; i < count; i++) {
+            queue_cpu_relax();
+        }
+    }
+};
+
+/* queue_backoff_spin_yield - spin for tight_spin_limit retries then yield */
+
+template <const int tight_spin_limit = 8>
+struct queue_backoff_spin_yield
+{
+    template <typename Notify, typename ATOMIC, typename VALUE>
+    static inline void backoff(int spin_count, Notify &, ATOMIC &, VALUE)
+    {
+        if (spin_count < tight_spin_limit) {
+            queue_cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+};
+
+/*
+ * queue_backoff_spin_park - spin for tight_spin_limit retries then park on the
+ * version word for at most park_us, woken early when used with queue_notify_futex
+ */
+
+template <const int tight_spin_limit = 64, const int park_us = 100>
+struct queue_backoff_spin_park
+{
+    template <typename Notify, typename ATOMIC, typename VALUE>
+    static inline void backoff(int spin_count, Notify &notify, ATOMIC &word, VALUE val)
+    {
+        if (spin_count < tight_spin_limit) {
+            queue_cpu_relax();
+        } else {
+            std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::now() + std::chrono::microseconds(park_us);
+            notify.park(word, val, &deadline);
+        }
+    }
+};
+
+
+/*
+ * cardinality policies
+ *
+ * a side with a single thread skips the counter compare_exchange and keeps a
+ * cached copy of the opposite offset, only reloading the opposite version word
+ * when the cached offset says the queue is full (push) or empty (pop).
+ */
+
+template <const bool MULTI_PRODUCER, const bool MULTI_CONSUMER>
+struct queue_cardinality
+{
+    static const bool multi_producer = MULTI_PRODUCER;
+    static const bool multi_consumer = MULTI_CONSUMER;
+};
+
+typedef queue_cardinality<true,true>   queue_mpmc;
+typedef queue_cardinality<true,false>  queue_mpsc;
+typedef queue_cardinality<false,true>  queue_spmc;
+typedef queue_cardinality<false,false> queue_spsc;
+
+
+/*
+ * queue_status
+ *
+ * result of try_push, emplace_back and try_pop. queue_busy means the spin limit
+ * was reached under contention, which is distinct from a full or empty queue.
+ */
+
+enum queue_status
+{
+    queue_ok,
+    queue_empty,
+    queue_full,
+    queue_busy
+};
+
+
+/*
+ * storage policies
+ *
+ * queue_storage_atomic keeps each slot as std::atomic<T> (the default).
+ * queue_storage_raw keeps each slot as a plain T, which allows non-atomic
+ * and move-only payload types and in-place access through reserve_back and
+ * peek_front;
+ * the slot is owned by the thread in the critical section and the version
+ * word publish orders the plain stores and loads.
+ * queue_storage_inline keeps trivially copyable T in a cache line aligned
+ * array and copies with memcpy, so large payloads never go through the
+ * libatomic lock table that std::atomic<T> falls back to above 16 bytes.
+ *
+ * pointer_t is the type of the queue's slot pointer, which a storage policy
+ * may replace with a position independent pointer (see queue_shm.h).
+ */
+
+template <typename T>
+struct queue_storage_atomic
+{
+    typedef std::atomic<T> item_t;
+    typedef item_t* pointer_t;
+    
+    static item_t* allocate(size_t n) { return new item_t[n](); }
+    static void deallocate(item_t *vec, size_t) { delete [] vec; }
+    
+    static inline void store(item_t &slot, const T &elem, std::memory_order order) { slot.store(elem, order); }
+    static inline T load(item_t &slot, std::memory_order order) { return slot.load(order); }
+    static inline T take(item_t &slot, std::memory_order order) { return slot.load(order); }
+    
+    template <typename... Args>
+    static inline void emplace(item_t &slot, std::memory_order order, Args&&... args)
+    {
+        slot.store(T(std::forward<Args>(args)...), order);
+    }
+    
+    template <typename InputIt>
+    static inline InputIt store_n(item_t *slot, InputIt first, size_t n, std::memory_order order)
+    {
+        for (item_t *end = slot + n; slot != end; ++slot, ++first) slot->store(*first, order);
+        return first;
+    }
+    
+    template <typename OutputIt>
+    static inline OutputIt load_n(item_t *slot, OutputIt first, size_t n, std::memory_order order)
+    {
+        for (item_t *end = slot + n; slot != end; ++slot, ++first) *first = slot->load(order);
+        return first;
+    }
+};
+
+template <typename T>
+struct queue_storage_raw
+{
+    typedef T item_t;
+    typedef item_t* pointer_t;
+    
+    static item_t* allocate(size_t n) { return new item_t[n](); }
+    static void deallocate(item_t *vec, size_t) { delete [] vec; }
+    
+    static inline void store(item_t &slot, const T &elem, std::memory_order) { slot = elem; }
+    static inline T load(item_t &slot, std::memory_order) { return slot; }
+    static inline T take(item_t &slot, std::memory_order) { return std::move(slot); }
+    
+    template <typename... Args>
+    static inline void emplace(item_t &slot, std::memory_order, Args&&... args)
+    {
+        slot = T(std::forward<Args>(args)...);
+    }
+    
+    template <typename InputIt>
+    static inline InputIt store_n(item_t *slot, InputIt first, size_t n, std::memory_order)
+    {
+        for (item_t *end = slot + n; slot != end; ++slot, ++first) *slot = *first;
+        return first;
+    }
+    
+    template <typename OutputIt>
+    static inline OutputIt load_n(item_t *slot, OutputIt first, size_t n, std::memory_order)
+    {
+        for (item_t *end = slot + n; slot != end; ++slot, ++first) *first = *slot;
+        return first;
+    }
+};
+
+template <typename T>
+struct queue_storage_inline
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "queue_storage_inline requires a trivially copyable type");
+    
+    typedef T item_t;
+    typedef item_t* pointer_t;
+    
+    static const size_t cache_line_size = 64;
+    
+    static item_t* allocate(size_t n)
+    {
+        void *vec = nullptr;
+#if defined(_MSC_VER)
+        vec = _aligned_malloc(n * sizeof(item_t), cache_line_size);
+#else
+        if (posix_memalign(&vec, cache_line_size, n * sizeof(item_t))) vec = nullptr;
+#endif
+        if (vec) memset(vec, 0, n * sizeof(item_t));
+        return static_cast<item_t*>(vec);
+    }
+    
+    static void deallocate(item_t *vec, size_t)
+    {
+#if defined(_MSC_VER)
+        _aligned_free(vec);
+#else
+        free(vec);
+#endif
+    }
+    
+    static inline void store(item_t &slot, const T &elem, std::memory_order)
+    {
+        memcpy(&slot, &elem, sizeof(T));
+    }
+    
+    static inline T load(item_t &slot, std::memory_order)
+    {
+        T elem;
+        memcpy(&elem, &slot, sizeof(T));
+        return elem;
+    }
+    
+    static inline T take(item_t &slot, std::memory_order order) { return load(slot, order); }
+    
+    template <typename... Args>
+    static inline void emplace(item_t &slot, std::memory_order, Args&&... args)
+    {
+        T elem(std::forward<Args>(args)...);
+        memcpy(&slot, &elem, sizeof(T));
+    }
+    
+    template <typename InputIt>
+    static inline InputIt store_n(item_t *slot, InputIt first, size_t n, std::memory_order order)
+    {
+        for (item_t *end = slot + n; slot != end; ++slot, ++first) memcpy(slot, &*first, sizeof(T));
+        return first;
+    }
+    
+    static inline const T* store_n(item_t *slot, const T *first, size_t n, std::memory_order order)
+    {
+        memcpy(slot, first, n * sizeof(T));
+        return first + n;
+    }
+    
+    static inline T* store_n(item_t *slot, T *first, size_t n, std::memory_order)
+    {
+        memcpy(slot, first, n * sizeof(T));
+        return first + n;
+    }
+    
+    template <typename OutputIt>
+    static inline OutputIt load_n(item_t *slot, OutputIt first, size_t n, std::memory_order order)
+    {
+        for (item_t *end = slot + n; slot != end; ++slot, ++first) memcpy(&*first, slot, sizeof(T));
+        return first;
+    }
+    
+    static inline T* load_n(item_t *slot, T *first, size_t n, std::memory_order)
+    {
+        memcpy(first, slot, n * sizeof(T));
+        return first + n;
+    }
+};
+
+/*
+ * allocator policies
+ *
+ * queue_alloc_mmap maps the ring directly instead of taking it from the heap:
+ *
+ *   - queue_pages_small uses the default page size
+ *   - queue_pages_transparent asks for transparent huge pages with
+ *     madvise(MADV_HUGEPAGE)
+ *   - queue_pages_huge maps MAP_HUGETLB pages from the reserved pool and
+ *     falls back to transparent huge pages when none are reserved
+ *
+ * NODE >= 0 binds the pages to that NUMA node with mbind and fails the
+ * allocation when the binding fails (e.g. no such node), and PREFAULT
+ * touches every page at construction so the page faults (and the placement)
+ * happen outside the hot path. elsewhere it falls back to aligned heap memory.
+ *
+ * queue_storage_alloc<Alloc, Storage>::policy is a storage policy that takes
+ * the slots of Storage from Alloc, e.g.
+ * queue_storage_alloc<queue_alloc_mmap<queue_pages_huge,0>>::policy
+ */
+
+enum queue_pages
+{
+    queue_pages_small,
+    queue_pages_transparent,
+    queue_pages_huge
+};
+
+template <const int PAGES = queue_pages_transparent,
+          const int NODE = -1,
+          const bool PREFAULT = true>
+struct queue_alloc_mmap
+{
+    static const size_t page_size =             4096;
+    static const size_t huge_page_size =        2 << 20;
+    static const int node =                     NODE < 0 ? 0 : NODE;
+    static const int mask_bits =                8 * sizeof(unsigned long);
+    
+    static inline size_t round(size_t bytes)
+    {
+        size_t align = PAGES == queue_pages_small ? page_size : huge_page_size;
+        return (bytes + align - 1) & ~(align - 1);
+    }
+    
+    static void* allocate(size_t bytes)
+    {
+        void *mem = nullptr;
+#if defined(__linux__)
+        size_t len = round(bytes);
+        if (PAGES == queue_pages_huge) {
+            mem = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mem == MAP_FAILED) mem = nullptr;
+        }
+        if (!mem) {
+            mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED) return nullptr;
+            if (PAGES != queue_pages_small) madvise(mem, len, MADV_HUGEPAGE);
+        }
+        if (NODE >= 0) {
+            /* before the first touch, which is where the pages are placed */
+            unsigned long nodemask[node / mask_bits + 1] = { 0 };
+            nodemask[node / mask_bits] = 1UL << (node % mask_bits);
+            if (syscall(SYS_mbind, mem, len, MPOL_BIND, nodemask, node + 2, 0) != 0) {
+                munmap(mem, len);
+                return nullptr;
+            }
+        }
+        if (PREFAULT) {
+            for (size_t i = 0; i < len; i += page_size) {
+                static_cast<volatile char*>(mem)[i] = 0;
+            }
+        }
+#elif defined(_MSC_VER)
+        mem = _aligned_malloc(bytes, page_size);
+        if (mem) memset(mem, 0, bytes);
+#else
+        if (posix_memalign(&mem, page_size, bytes)) return nullptr;
+        memset(mem, 0, bytes);
+#endif
+        return mem;
+    }
+    
+    static void deallocate(void *mem, size_t bytes)
+    {
+#if defined(__linux__)
+        munmap(mem, round(bytes));
+#elif defined(_MSC_VER)
+        _aligned_free(mem);
+#else
+        free(mem);
+#endif
+    }
+};
+
+template <typename Alloc,
+          template <typename> class Storage = queue_storage_atomic>
+struct queue_storage_alloc
+{
+    template <typename T>
+    struct policy : Storage<T>
+    {
+        typedef typename Storage<T>::item_t item_t;
+        
+        /* the memory comes back zeroed, so only non-trivial slots are constructed */
+        static item_t* allocate(size_t n)
+        {
+            item_t *vec = static_cast<item_t*>(Alloc::allocate(n * sizeof(item_t)));
+            if (vec && !std::is_trivially_default_constructible<item_t>::value) {
+                for (size_t i = 0; i < n; i++) new (vec + i) item_t();
+            }
+            return vec;
+        }
+        
+        static void deallocate(item_t *vec, size_t n)
+        {
+            if (!std::is_trivially_destructible<item_t>::value) {
+                for (size_t i = 0; i < n; i++) vec[i].~item_t();
+            }
+            Alloc::deallocate(vec, n * sizeof(item_t));
+        }
+    };
+};
+
+/*
+ * layout policies
+ *
+ * map a queue offset to a slot index. with small items many logically
+ * adjacent slots share a cache line, so a producer storing the back slot and
+ * a consumer loading the front slot of a nearly empty queue keep moving the
+ * same line between cores.
+ *
+ *   - queue_layout_linear (default) stores offset i in slot i
+ *   - queue_layout_rotate rotates the index bits left by log2(slots per line)
+ *     so consecutive offsets land on consecutive cache lines, and a line is
+ *     only revisited after size_limit / slots per line offsets
+ *   - queue_layout_padded spaces slots a cache line apart, allocating
+ *     size_limit * slots per line slots
+ *
+ * remapped layouts have no contiguous runs, so reserve_back and peek_front
+ * need queue_layout_linear and push_back_n and pop_front_n copy item by item.
+ */
+
+struct queue_layout_linear
+{
+    static const bool contiguous = true;
+    
+    static inline size_t slots(size_t size_limit, size_t) { return size_limit; }
+    
+    static inline size_t index(size_t offset, size_t size_limit, size_t)
+    {
+        return offset & (size_limit - 1);
+    }
+};
+
+template <const size_t LINE = 64>
+struct queue_layout_rotate
+{
+    static const bool contiguous = false;
+    
+    static inline size_t slots(size_t size_limit, size_t) { return size_limit; }
+    
+    /* floor of log2(val) for val > 0 */
+    static inline int ilog2(uint64_t val)
+    {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(val);
+#else
+        int b = -1;
+        while (val) { b++; val >>= 1; }
+        return b;
+#endif
+    }
+    
+    static inline size_t index(size_t offset, size_t size_limit, size_t item_size)
+    {
+        /* log2 of the slots per line (rounded up) and of size_limit */
+        int line_bits = item_size >= LINE ? 0 : ilog2(LINE) - ilog2(item_size);
+        int size_bits = ilog2(size_limit);
+        int rotate = line_bits < size_bits ? line_bits : size_bits;
+        size_t i = offset & (size_limit - 1);
+        if (rotate == 0) return i;
+        return ((i << rotate) | (i >> (size_bits - rotate))) & (size_limit - 1);
+    }
+};
+
+template <const size_t LINE = 64>
+struct queue_layout_padded
+{
+    static const bool contiguous = false;
+    
+    static inline size_t stride(size_t item_size) { return (LINE + item_size - 1) / item_size; }
+    
+    static inline size_t slots(size_t size_limit, size_t item_size) { return size_limit * stride(item_size); }
+    
+    static inline size_t index(size_t offset, size_t size_limit, size_t item_size)
+    {
+        return (offset & (size_limit - 1)) * stride(item_size);
+    }
+};
+
+/*
+ * overflow policies
+ *
+ * queue_overflow_reject (default) fails a push onto a full queue with
+ * queue_full. queue_overflow_overwrite makes a push onto a full queue drop
+ * the oldest item and take its slot, for telemetry rings that would rather
+ * lose old data than block or fail. the oldest item is claimed through the
+ * normal pop protocol so a consumer never reads a slot that is being
+ * overwritten; the number of dropped items is counted so consumers can tell
+ * they were lapped with lapped().
+ */
+
+struct queue_overflow_reject
+{
+    static const bool overwrite = false;
+};
+
+struct queue_overflow_overwrite
+{
+    static const bool overwrite = true;
+};
+
+/*
+ * stats policies
+ *
+ * collect contention statistics for claim_back and claim_front without
+ * logging from inside the retry loop.
+ *
+ * queue_stats_none compiles to nothing. queue_stats_thread keeps cache line
+ * padded counters per thread (threads are hashed onto max_threads records)
+ * that are bumped with relaxed loads and stores, plus log2 histograms of the
+ * retry count and the rdtsc cycles per claim. snapshot() sums the records on
+ * demand. threads sharing a record may lose counts, so size max_threads to
+ * the number of threads using the queue. a single producer or consumer side
+ * never retries and is not counted.
+ */
+
+struct queue_stats_snapshot
+{
+    static const int hist_buckets =             32;
+    
+    uint64_t attempts;
+    uint64_t phase1_failures;
+    uint64_t phase2_failures;
+    uint64_t retries;
+    uint64_t spin_limit_exhausted;
+    uint64_t cycles;
+    uint64_t retry_hist[hist_buckets];
+    uint64_t cycle_hist[hist_buckets];
+    
+    /* bucket 0 holds zero, bucket i holds [2^(i-1), 2^i) */
+    static inline int bucket(uint64_t val)
+    {
+#if defined(__GNUC__)
+        int b = val ? 64 - __builtin_clzll(val) : 0;
+#else
+        int b = 0;
+        while (val) { b++; val >>= 1; }
+#endif
+        return b < hist_buckets ? b : hist_buckets - 1;
+    }
+};
+
+struct queue_stats_none
+{
+    static inline uint64_t begin() { return 0; }
+    inline void phase1_failure() {}
+    inline void phase2_failure() {}
+    inline void end(uint64_t, int, bool) {}
+    
+    queue_stats_snapshot snapshot() const
+    {
+        queue_stats_snapshot s;
+        memset(&s, 0, sizeof(s));
+        return s;
+    }
+};
+
+/*
+ * queue_thread_index - small dense index for the calling thread, assigned on
+ * first use; picks the stats record and the home lane of queue_sharded
+ */
+
+inline unsigned queue_thread_index()
+{
+    static std::atomic<unsigned> next_index(0);
+    static thread_local unsigned index = next_index.fetch_add(1, std::memory_order_relaxed);
+    return index;
+}
+
+template <const int max_threads = 64>
+struct queue_stats_thread
+{
+    static const int hist_buckets =             queue_stats_snapshot::hist_buckets;
+    
+    static_assert((max_threads & (max_threads - 1)) == 0, "max_threads must be a power of 2");
+    
+    struct record
+    {
+        ALIGNED(64) std::atomic<uint64_t> attempts;
+        std::atomic<uint64_t> phase1_failures;
+        std::atomic<uint64_t> phase2_failures;
+        std::atomic<uint64_t> retries;
+        std::atomic<uint64_t> spin_limit_exhausted;
+        std::atomic<uint64_t> cycles;
+        std::atomic<uint64_t> retry_hist[hist_buckets];
+        std::atomic<uint64_t> cycle_hist[hist_buckets];
+    };
+    
+    record records[max_threads];
+    
+    queue_stats_thread() { reset(); }
+    
+    /* single writer per record, so a relaxed load and store is enough */
+    static inline void bump(std::atomic<uint64_t> &c, uint64_t n = 1)
+    {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    
+    inline record& local() { return records[queue_thread_index() & (max_threads - 1)]; }
+    
+    static inline uint64_t begin() { return rdtsc(); }
+    inline void phase1_failure() { bump(local().phase1_failures); }
+    inline void phase2_failure() { bump(local().phase2_failures); }
+    
+    inline void end(uint64_t start, int spin_count, bool exhausted)
+    {
+        uint64_t cycles = rdtsc() - start;
+        record &r = local();
+        bump(r.attempts);
+        bump(r.retries, spin_count);
+        bump(r.cycles, cycles);
+        if (exhausted) bump(r.spin_limit_exhausted);
+        bump(r.retry_hist[queue_stats_snapshot::bucket(spin_count)]);
+        bump(r.cycle_hist[queue_stats_snapshot::bucket(cycles)]);
+    }
+    
+    void reset()
+    {
+        for (int i = 0; i < max_threads; i++) {
+            record &r = records[i];
+            r.attempts = r.phase1_failures = r.phase2_failures = 0;
+            r.retries = r.spin_limit_exhausted = r.cycles = 0;
+            for (int b = 0; b < hist_buckets; b++) {
+                r.retry_hist[b] = r.cycle_hist[b] = 0;
+            }
+        }
+    }
+    
+    queue_stats_snapshot snapshot() const
+    {
+        queue_stats_snapshot s;
+        memset(&s, 0, sizeof(s));
+        for (int i = 0; i < max_threads; i++) {
+            const record &r = records[i];
+            s.attempts += r.attempts.load(std::memory_order_relaxed);
+            s.phase1_failures += r.phase1_failures.load(std::memory_order_relaxed);
+            s.phase2_failures += r.phase2_failures.load(std::memory_order_relaxed);
+            s.retries += r.retries.load(std::memory_order_relaxed);
+            s.spin_limit_exhausted += r.spin_limit_exhausted.load(std::memory_order_relaxed);
+            s.cycles += r.cycles.load(std::memory_order_relaxed);
+            for (int b = 0; b < hist_buckets; b++) {
+                s.retry_hist[b] += r.retry_hist[b].load(std::memory_order_relaxed);
+                s.cycle_hist[b] += r.cycle_hist[b].load(std::memory_order_relaxed);
+            }
+        }
+        return s;
+    }
+};
+
+/*
+ * queue_base - gives queue_atomic its virtual destructor, except when the storage
+ * policy has a position independent slot pointer. such a queue lives in a shared
+ * memory block (queue_shm.h), where a vtable pointer written by one process is
+ * not valid in another, so it is left non-polymorphic.
+ */
+
+template <const bool polymorphic>
+struct queue_base
+{
+    virtual ~queue_base() {}
+};
+
+template <>
+struct queue_base<false> {};
+
+/*
+ * queue_counter - the counter word of one side of queue_atomic. a side with a
+ * single thread never enters a critical section, so its counter is empty.
+ */
+
+template <typename W, const bool shared>
+struct queue_counter : W
+{
+    template <typename V> queue_counter(V val) : W(val) {}
+};
+
+template <typename W>
+struct queue_counter<W,false>
+{
+    template <typename V> queue_counter(V) {}
+};
+
+template <typename T,
+          const int debug_contention = false,
+          typename ATOMIC_UINT = uint64_t,
+          const int OFFSET_BITS = 48,
+          const int VERSION_BITS = 16,
+          std::memory_order relaxed_memory_order = std::memory_order_relaxed,
+          std::memory_order acquire_memory_order = std::memory_order_acquire,
+          std::memory_order release_memory_order = std::memory_order_release,
+          typename Notify = queue_notify_none,
+          typename Backoff = queue_backoff_spin_yield<>,
+          typename Cardinality = queue_mpmc,
+          template <typename> class Storage = queue_storage_atomic,
+          typename Stats = queue_stats_none,
+          typename Overflow = queue_overflow_reject,
+          typename Layout = queue_layout_linear>
+struct queue_atomic : queue_base<std::is_same<typename Storage<T>::pointer_t,
+                                              typename Storage<T>::item_t*>::value>
+{
+    /* queue atomic type */
+    
+    typedef ATOMIC_UINT                         atomic_uint_t;
+    typedef typename queue_atomic_word<atomic_uint_t>::type atomic_word_t;
+    typedef std::atomic<T>                      atomic_item_t;
+    typedef Notify                              notify_t;
+    typedef Backoff                             backoff_t;
+    typedef Cardinality                         cardinality_t;
+    typedef Storage<T>                          storage_t;
+    typedef typename storage_t::item_t          item_t;
+    typedef typename storage_t::pointer_t       pointer_t;
+    typedef Overflow                            overflow_t;
+    typedef Layout                              layout_t;
+    typedef queue_counter<atomic_word_t,cardinality_t::multi_producer> back_counter_t;
+    typedef queue_counter<atomic_word_t,cardinality_t::multi_consumer> front_counter_t;
+    
+    /* debug_contention selects per-thread stats unless a Stats policy is given */
+    typedef typename std::conditional<debug_contention &&
+        std::is_same<Stats,queue_stats_none>::value,
+        queue_stats_thread<>, Stats>::type     stats_t;
+    
+    
+    /* queue constants */
+    
+    static const int spin_limit =               1 << 24;
+    static const int debug_spin =               true;
+    static const int wait_spin_limit =          64;
+    static const bool multi_producer =          cardinality_t::multi_producer;
+    static const bool multi_consumer =          cardinality_t::multi_consumer;
+    static const bool overwrite =               overflow_t::overwrite;
+    static const int atomic_bits =              sizeof(atomic_uint_t) << 3;
+    static const int offset_bits =              OFFSET_BITS;
+    static const int version_bits =             VERSION_BITS;
+    static const int offset_shift =             0;
+    static const int version_shift =            offset_bits;
+    static const bool packed_counter =          atomic_bits > 64;
+    static const int counter_shift =            packed_counter ? version_shift + version_bits : 0;
+    static const atomic_uint_t size_max =       ((atomic_uint_t)1 << (offset_bits - 1));
+    static const atomic_uint_t offset_limit =   ((atomic_uint_t)1 << offset_bits);
+    static const atomic_uint_t version_limit =  ((atomic_uint_t)1 << version_bits);
+    static const atomic_uint_t offset_mask =    ((atomic_uint_t)1 << offset_bits) - 1;
+    static const atomic_uint_t version_mask =   ((atomic_uint_t)1 << version_bits) - 1;
+    
+    
+    /* queue storage */
+    
+    ALIGNED(64) pointer_t vec;
+    const atomic_uint_t size_limit;
+    ALIGNED(64) back_counter_t counter_back;
+    atomic_word_t version_back;
+    notify_t notify_back;
+    atomic_uint_t cached_front;
+    std::atomic<uint64_t> dropped_count;
+    ALIGNED(64) front_counter_t counter_front;
+    atomic_word_t version_front;
+    notify_t notify_front;
+    atomic_uint_t cached_back;
+    stats_t stats;
+    
+    
+    /* queue helpers */
+    
+    static inline bool ispow2(size_t val) { return val && !(val & (val-1)); }
+    
+    /* number of slots allocated for size_limit offsets */
+    static inline size_t slot_count(size_t size_limit) { return layout_t::slots(size_limit, sizeof(item_t)); }
+    
+    /* the slot holding a queue offset */
+    inline item_t& slot(atomic_uint_t offset)
+    {
+        return vec[layout_t::index((size_t)offset, (size_t)size_limit, sizeof(item_t))];
+    }
+    
+    /*
+     * pack a version number and an offset into an unsigned atomic integer
+     *
+     * with a double-width atomic integer the counter is packed above the version
+     * and is equal to the version outside of the critical section
+     */
+    static inline const atomic_uint_t pack_offset(const atomic_uint_t version, const atomic_uint_t offset)
+    {
+        assert(version < version_limit);
+        assert(offset < offset_limit);
+        return (packed_counter ? version << counter_shift : 0) |
+               (version << version_shift) | (offset << offset_shift);
+    }
+    
+    /*
+     * replace the packed counter with a new counter value to enter the critical section
+     */
+    static inline const atomic_uint_t pack_counter(const atomic_uint_t pack, const atomic_uint_t counter)
+    {
+        return (pack & ~(version_mask << counter_shift)) | ((counter & version_mask) << counter_shift);
+    }
+    
+    /*
+     * unpack a version number and offset and compare the version to a counter value
+     * returns true if the version in the counter matches the version packed in the offset
+     */
+    static inline bool unpack_offsets(const atomic_uint_t counter, const atomic_uint_t pack,
+                                      atomic_uint_t &offset)
+    {
+        if (((pack >> version_shift) & version_mask) == (counter & version_mask)) {
+            offset = (pack >> offset_shift) & offset_mask;
+            return true;
+        }
+        return false;
+    }
+    
+    /* queue implementation */
+    
+    atomic_uint_t _back_version()   { return (version_back >> version_shift) & version_mask; }
+    atomic_uint_t _front_version()  { return (version_front >> version_shift) & version_mask; }
+    atomic_uint_t _back()           { return (version_back >> offset_shift) & offset_mask; }
+    atomic_uint_t _front()          { return (version_front >> offset_shift) & offset_mask; }
+    size_t capacity()               { return size_limit; }
+    
+    
+    /*
+     * allocate slot_count(size_limit) slots from the storage policy, throwing
+     * std::bad_alloc when it returns nullptr (like the heap default does)
+     */
+    queue_atomic(size_t size_limit) : queue_atomic(size_limit, nullptr)
+    {
+        vec = storage_t::allocate(slot_count(size_limit));
+        if (!vec) throw std::bad_alloc();
+    }
+    
+    /*
+     * use slot_count(size_limit) slots provided by the caller, which the storage policy
+     * deallocate hook releases (or not) with the queue
+     */
+    queue_atomic(size_t size_limit, item_t *slots) :
+        vec(slots),
+        size_limit(size_limit),
+        counter_back(0),
+        version_back(pack_offset(0, 0)),
+        cached_front(size_limit),
+        dropped_count(0),
+        counter_front(0),
+        version_front(pack_offset(0, size_limit)),
+        cached_back(0)
+    {
+        static_assert(version_bits * (packed_counter ? 2 : 1) + offset_bits <= atomic_bits,
+                      "version_bits + offset_bits (+ counter bits) must fit into atomic integer type");
+        static_assert(!packed_counter || offset_bits <= 64,
+                      "offset must fit in the low half of a double-width atomic integer");
+        static_assert(!overwrite || multi_consumer,
+                      "overwrite mode drops from the front so it needs the multiple consumer claim");
+        assert(size_limit > 0);
+        assert(size_limit <= size_max);
+        assert(ispow2(size_limit));
+    }
+    
+    /* virtual through queue_base unless the slot pointer is position independent */
+    ~queue_atomic()
+    {
+        if (vec) storage_t::deallocate(vec, slot_count(size_limit));
+    }
+    
+    bool empty()
+    {
+        atomic_uint_t back = (version_back >> offset_shift) & offset_mask;
+        atomic_uint_t front = (version_front >> offset_shift) & offset_mask;
+        
+        /* return true if queue is empty */
+        return (front - back == size_limit);
+    }
+    
+    bool full()
+    {
+        atomic_uint_t back = (version_back >> offset_shift) & offset_mask;
+        atomic_uint_t front = (version_front >> offset_shift) & offset_mask;
+
+        /* return true if queue is full */
+        return (front == back);
+    }
+    
+    size_t size()
+    {
+        atomic_uint_t back = (version_back >> offset_shift) & offset_mask;
+        atomic_uint_t front = (version_front >> offset_shift) & offset_mask;
+
+        /* return queue size */
+        return size_limit - front + back;
+    }
+    
+    /*
+     * claim_back - phase 1 prepare and phase 2 enter of push back
+     *
+     * claims up to n contiguous slots at the back of the queue with a single
+     * compare_exchange on counter_back. on success returns the number of slots
+     * claimed, the back offset of the first slot and the packed version_back
+     * that the caller must store to leave the critical section. returns zero
+     * and sets status to queue_full or queue_busy if the queue is full or the
+     * spin limit is reached, or queue_ok if n is zero.
+     */
+    size_t claim_back(size_t n, atomic_uint_t &back, atomic_uint_t &pack, queue_status &status)
+    {
+        /* an empty claim must not enter the critical section, the caller never leaves it */
+        if (n == 0) {
+            status = queue_ok;
+            return 0;
+        }
+        
+        return claim_back(n, back, pack, status, std::integral_constant<bool,multi_producer>());
+    }
+    
+    /* a single producer has no counter_back and no critical section to enter */
+    size_t claim_back(size_t n, atomic_uint_t &back, atomic_uint_t &pack, queue_status &status, std::false_type)
+    {
+        return claim_back_single(n, back, pack, status);
+    }
+    
+    size_t claim_back(size_t n, atomic_uint_t &back, atomic_uint_t &pack, queue_status &status, std::true_type)
+    {
+        atomic_uint_t front;
+        uint64_t start = stats.begin();
+
+        int spin_count = 0;
+        do {
+            /*
+             * if packed version equals counter_back then attempt push back
+             *
+             * this is where we detect if another thread is in the push back
+             * critical section and we only proceed if the versions are consistent:
+             *
+             *     i.e. counter_back == version_back >> version_shift & version_mask
+             */
+            atomic_uint_t _counter_back = packed_counter ? 0 : counter_back.load(relaxed_memory_order);
+            atomic_uint_t _version_back = version_back.load(acquire_memory_order);
+            if (packed_counter) _counter_back = (_version_back >> counter_shift) & version_mask;
+            if (unpack_offsets(_counter_back, _version_back, back))
+            {
+                /* reload front each attempt so a stale snapshot does not report full */
+                front = (version_front.load(acquire_memory_order) >> offset_shift) & offset_mask;
+                
+                /* if (full) return 0; */
+                if (front == back) {
+                    stats.end(start, spin_count, false);
+                    status = queue_full;
+                    return 0;
+                }
+                
+                /* clamp the claim to the free space */
+                size_t count = n < front - back ? n : front - back;
+                
+                /*
+                 * create new back version
+                 *
+                 * the counter is kept unmasked so a thread preempted across a wrap of
+                 * the packed version field can not win the compare_exchange (ABA)
+                 */
+                atomic_uint_t new_back_version = _counter_back + 1;
+                
+                /* pack new back version and back offset */
+                pack = pack_offset(new_back_version & version_mask, (back + count) & (offset_limit - 1));
+                
+                /*
+                 * compare_exchange_weak and attempt to update the counter with the new version
+                 * (the counter packed in version_back when using a double-width atomic integer)
+                 *
+                 * this is where we enter the critical section:
+                 *
+                 *     i.e. counter_back != version_back >> version_shift & version_mask
+                 *     for a brief number of instructions until we write the new version_back
+                 *
+                 * if successful other threads will spin until new version_back is visible
+                 * if successful the caller writes the values followed by writing a new
+                 * version_back to leave the critical section
+                 */
+                bool entered = packed_counter
+                    ? version_back.compare_exchange_weak(_version_back, pack_counter(_version_back, new_back_version),
+                                                           std::memory_order_acq_rel)
+                    : counter_back.compare_exchange_weak(_counter_back, new_back_version,
+                                                           std::memory_order_acq_rel);
+                if (entered)
+                {
+                    stats.end(start, spin_count, false);
+                    status = queue_ok;
+                    return count;
+                    
+                } else {
+                    stats.phase2_failure();
+                }
+            } else {
+                stats.phase1_failure();
+            }
+
+            /*
+             * if we reach here then we detected an inconsistent version in phase 1 prepare
+             * or failed to update the counter to enter the critical section in phase 2
+             */
+
+            /* back off before retrying */
+            backoff_t::backoff(spin_count, notify_back, version_back, _version_back);
+            
+        } while (++spin_count < spin_limit);
+        
+        if (debug_spin) {
+            log_debug("%s thread:%p failed: reached spin limit", __func__, std::this_thread::get_id());
+        }
+        
+        stats.end(start, spin_count, true);
+        status = queue_busy;
+        return 0;
+    }
+    
+    /*
+     * claim_front - phase 1 prepare and phase 2 enter of pop front
+     *
+     * claims up to n contiguous slots at the front of the queue with a single
+     * compare_exchange on counter_front. on success returns the number of slots
+     * claimed, the front offset of the first slot and the packed version_front
+     * that the caller must store to leave the critical section. returns zero
+     * and sets status to queue_empty or queue_busy if the queue is empty or the
+     * spin limit is reached, or queue_ok if n is zero.
+     */
+    size_t claim_front(size_t n, atomic_uint_t &front, atomic_uint_t &pack, queue_status &status)
+    {
+        /* an empty claim must not enter the critical section, the caller never leaves it */
+        if (n == 0) {
+            status = queue_ok;
+            return 0;
+        }
+        
+        return claim_front(n, front, pack, status, std::integral_constant<bool,multi_consumer>());
+    }
+    
+    /* a single consumer has no counter_front and no critical section to enter */
+    size_t claim_front(size_t n, atomic_uint_t &front, atomic_uint_t &pack, queue_status &status, std::false_type)
+    {
+        return claim_front_single(n, front, pack, status);
+    }
+    
+    size_t claim_front(size_t n, atomic_uint_t &front, atomic_uint_t &pack, queue_status &status, std::true_type)
+    {
+        atomic_uint_t back;
+        uint64_t start = stats.begin();
+        
+        int spin_count = 0;
+        do {
+            /*
+             * if packed version equals counter_front then attempt pop front
+             *
+             * this is where we detect if another thread is in the pop front
+             * critical section and we only proceed if the versions are consistent:
+             *
+             *     i.e. counter_front == version_front >> version_shift & version_mask
+             */
+            atomic_uint_t _counter_front = packed_counter ? 0 : counter_front.load(relaxed_memory_order);
+            atomic_uint_t _version_front = version_front.load(acquire_memory_order);
+            if (packed_counter) _counter_front = (_version_front >> counter_shift) & version_mask;
+            if (unpack_offsets(_counter_front, _version_front, front))
+            {
+                /* reload back each attempt so a stale snapshot does not report empty */
+                back = (version_back.load(acquire_memory_order) >> offset_shift) & offset_mask;
+                
+                /* if (empty) return 0; */
+                if (front - back == size_limit) {
+                    stats.end(start, spin_count, false);
+                    status = queue_empty;
+                    return 0;
+                }
+                
+                /* clamp the claim to the used space */
+                size_t count = n < size_limit - front + back ? n : size_limit - front + back;
+                
+                /*
+                 * create new front version
+                 *
+                 * the counter is kept unmasked so a thread preempted across a wrap of
+                 * the packed version field can not win the compare_exchange (ABA)
+                 */
+                atomic_uint_t new_front_version = _counter_front + 1;
+                
+                /* pack new front version and front offset */
+                pack = pack_offset(new_front_version & version_mask, (front + count) & (offset_limit - 1));
+                
+                /*
+                 * compare_exchange_weak and attempt to update the counter with the new version
+                 * (the counter packed in version_front when using a double-width atomic integer)
+                 *
+                 * this is where we enter the critical section:
+                 *
+                 *     i.e. counter_front != version_front >> version_shift & version_mask
+                 *     for a brief number of instructions until we write the new version_front
+                 *
+                 * if successful other threads will spin until new version_front is visible
+                 * if successful the caller reads the values followed by writing a new
+                 * version_front to leave the critical section
+                 */
+                bool entered = packed_counter
+                    ? version_front.compare_exchange_weak(_version_front, pack_counter(_version_front, new_front_version),
+                                                           std::memory_order_acq_rel)
+                    : counter_front.compare_exchange_weak(_counter_front, new_front_version,
+                                                           std::memory_order_acq_rel);
+                if (entered)
+                {
+                    stats.end(start, spin_count, false);
+                    status = queue_ok;
+                    return count;
+                    
+                } else {
+                    stats.phase2_failure();
+                }
+            } else {
+                stats.phase1_failure();
+            }
+            
+            /*
+             * if we reach here then we detected an inconsistent version in phase 1 prepare
+             * or failed to update the counter to enter the critical section in phase 2
+             */
+            
+            /* back off before retrying */
+            backoff_t::backoff(spin_count, notify_front, version_front, _version_front);
+            
+        } while (++spin_count < spin_limit);
+        
+        if (debug_spin) {
+            log_debug("%s thread:%p failed: reached spin limit", __func__, std::this_thread::get_id());
+        }
+        
+        stats.end(start, spin_count, true);
+        status = queue_busy;
+        return 0;
+    }
+    
+    /*
+     * claim_back_single - push back claim for a single producer
+     *
+     * the producer is the only writer of version_back so there is no critical
+     * section to enter: there is no counter_back and front is read from the cached
+     * copy, reloading version_front only when the cached front is too close.
+     */
+    size_t claim_back_single(size_t n, atomic_uint_t &back, atomic_uint_t &pack, queue_status &status)
+    {
+        atomic_uint_t _version_back = version_back.load(relaxed_memory_order);
+        back = (_version_back >> offset_shift) & offset_mask;
+        
+        /* if the cached front does not leave room for n, reload front */
+        if (cached_front - back < n) {
+            cached_front = (version_front.load(acquire_memory_order) >> offset_shift) & offset_mask;
+            if (cached_front == back) {
+                status = queue_full;
+                return 0;
+            }
+        }
+        
+        /* clamp the claim to the free space */
+        size_t count = n < cached_front - back ? n : cached_front - back;
+        
+        /* pack new back version and back offset */
+        atomic_uint_t new_back_version = ((_version_back >> version_shift) + 1) & version_mask;
+        pack = pack_offset(new_back_version, (back + count) & (offset_limit - 1));
+        status = queue_ok;
+        return count;
+    }
+    
+    /*
+     * claim_front_single - pop front claim for a single consumer
+     *
+     * the consumer is the only writer of version_front so there is no critical
+     * section to enter: there is no counter_front and back is read from the cached
+     * copy, reloading version_back only when the cached back is too close.
+     */
+    size_t claim_front_single(size_t n, atomic_uint_t &front, atomic_uint_t &pack, queue_status &status)
+    {
+        atomic_uint_t _version_front = version_front.load(relaxed_memory_order);
+        front = (_version_front >> offset_shift) & offset_mask;
+        
+        /* if the cached back does not hold n items, reload back */
+        if (size_limit - front + cached_back < n) {
+            cached_back = (version_back.load(acquire_memory_order) >> offset_shift) & offset_mask;
+            if (front - cached_back == size_limit) {
+                status = queue_empty;
+                return 0;
+            }
+        }
+        
+        /* clamp the claim to the used space */
+        size_t count = n < size_limit - front + cached_back ? n : size_limit - front + cached_back;
+        
+        /* pack new front version and front offset */
+        atomic_uint_t new_front_version = ((_version_front >> version_shift) + 1) & version_mask;
+        pack = pack_offset(new_front_version, (front + count) & (offset_limit - 1));
+        status = queue_ok;
+        return count;
+    }
+    
+    /*
+     * claim_back_overwrite - claim_back that makes room when overwriting
+     *
+     * with queue_overflow_overwrite the oldest items are dropped until up to n
+     * slots are free (a batch may still come up short if other producers claim
+     * slots in the meantime) and a claim that finds the queue full drops one
+     * more item and retries; otherwise this is claim_back.
+     */
+    size_t claim_back_overwrite(size_t n, atomic_uint_t &back, atomic_uint_t &pack, queue_status &status)
+    {
+        int spin_count = 0;
+        if (overwrite && n > 1) {
+            size_t want = n < size_limit ? n : (size_t)size_limit;
+            while (size_limit - size() < want && spin_count < spin_limit) {
+                if (!drop_front()) backoff_front(spin_count++);
+            }
+        }
+        for (;;) {
+            size_t count = claim_back(n, back, pack, status);
+            if (count || !overwrite || status != queue_full) return count;
+            if (drop_front()) continue;
+            if (spin_count >= spin_limit) {
+                status = queue_busy;
+                return 0;
+            }
+            backoff_front(spin_count++);
+        }
+    }
+    
+    /* back off while dropping keeps losing the front to consumers or other producers */
+    void backoff_front(int spin_count)
+    {
+        backoff_t::backoff(spin_count, notify_front, version_front, version_front.load(relaxed_memory_order));
+    }
+    
+    /*
+     * drop_front - claim the front slot like a pop, discard the item and count it
+     *
+     * returns false if the front could not be claimed under contention; a queue
+     * that consumers emptied in the meantime already has room
+     */
+    bool drop_front()
+    {
+        atomic_uint_t front, pack;
+        queue_status status;
+        
+        if (!claim_front(1, front, pack, status)) return status == queue_empty;
+        
+        storage_t::take(slot(front), acquire_memory_order);
+        version_front.store(pack, release_memory_order);
+        notify_front.notify(version_front);
+        dropped_count.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    
+    /* number of items dropped by overwriting pushes */
+    uint64_t dropped() { return dropped_count.load(std::memory_order_relaxed); }
+    
+    /*
+     * lapped - number of items dropped since the caller last checked
+     *
+     * each consumer keeps its own seen count (initially zero); a nonzero result
+     * means the producer lapped the consumers and the items between the last
+     * item read and the next item popped were lost. pops already continue from
+     * the oldest item still in the queue so no other resynchronization is needed.
+     */
+    uint64_t lapped(uint64_t &seen)
+    {
+        uint64_t d = dropped();
+        uint64_t n = d - seen;
+        seen = d;
+        return n;
+    }
+    
+    /*
+     * emplace_back - construct an item in the next back slot
+     *
+     * returns queue_ok, queue_full, or queue_busy if the spin limit was reached
+     * under contention, so callers can tell backpressure from contention.
+     * with queue_overflow_overwrite a full queue drops its oldest item instead.
+     */
+    template <typename... Args>
+    queue_status emplace_back(Args&&... args)
+    {
+        atomic_uint_t back, pack;
+        queue_status status;
+        
+        if (!claim_back_overwrite(1, back, pack, status)) return status;
+        
+        storage_t::emplace(slot(back), release_memory_order, std::forward<Args>(args)...);
+        
+        /*
+         * exit the critical section and reveal the new back offset to other threads
+         *
+         *    i.e. counter_back == version_back >> version_shift & version_mask
+         */
+        version_back.store(pack, release_memory_order);
+        notify_back.notify(version_back);
+        return queue_ok;
+    }
+    
+    queue_status try_push(const T &elem) { return emplace_back(elem); }
+    queue_status try_push(T &&elem)      { return emplace_back(std::move(elem)); }
+    bool push_back(const T &elem)        { return emplace_back(elem) == queue_ok; }
+    bool push_back(T &&elem)             { return emplace_back(std::move(elem)) == queue_ok; }
+    
+    /*
+     * try_pop - move the front item into out
+     *
+     * returns queue_ok, queue_empty, or queue_busy if the spin limit was reached
+     * under contention. unlike pop_front there is no T(0) sentinel so T may be
+     * move-only and zero is a legitimate value.
+     */
+    queue_status try_pop(T &out)
+    {
+        atomic_uint_t front, pack;
+        queue_status status;
+        
+        if (!claim_front(1, front, pack, status)) return status;
+        
+        out = storage_t::take(slot(front), acquire_memory_order);
+        
+        version_front.store(pack, release_memory_order);
+        notify_front.notify(version_front);
+        return queue_ok;
+    }
+    
+    T pop_front()
+    {
+        atomic_uint_t front, pack;
+        queue_status status;
+        
+        if (!claim_front(1, front, pack, status)) return T(0);
+        
+        T val = storage_t::load(slot(front), acquire_memory_order);
+        
+        /*
+         * exit the critical section and reveal the new front offset to other threads
+         *
+         *    i.e. counter_front == version_front >> version_shift & version_mask
+         */
+        version_front.store(pack, release_memory_order);
+        notify_front.notify(version_front);
+        return val;
+    }
+    
+    /*
+     * slot_span - up to n claimed slots split into at most two contiguous runs at
+     * the wrap-around point, plus the packed version word to publish
+     */
+    struct slot_span
+    {
+        item_t *first;
+        size_t first_count;
+        item_t *second;
+        size_t second_count;
+        atomic_uint_t pack;
+        
+        size_t size() const { return first_count + second_count; }
+        explicit operator bool() const { return first_count != 0; }
+        item_t& operator[](size_t i) { return i < first_count ? first[i] : second[i - first_count]; }
+    };
+    
+    slot_span make_span(atomic_uint_t offset, size_t count, atomic_uint_t pack)
+    {
+        size_t index = offset & (size_limit - 1);
+        size_t run = count < size_limit - index ? count : size_limit - index;
+        slot_span span = { vec + index, run, vec, count - run, pack };
+        return span;
+    }
+    
+    /*
+     * reserve_back - claim up to n slots at the back to be written in place
+     *
+     * the slots belong to the caller until commit() publishes them. other producers
+     * spin until then so the span should be filled promptly. returns an empty span
+     * if the queue is full.
+     */
+    slot_span reserve_back(size_t n = 1)
+    {
+        static_assert(layout_t::contiguous, "reserve_back needs queue_layout_linear");
+        atomic_uint_t back = 0, pack = 0;
+        queue_status status;
+        
+        size_t count = claim_back_overwrite(n, back, pack, status);
+        return make_span(back, count, pack);
+    }
+    
+    void commit(const slot_span &span)
+    {
+        /* the release store of version_back orders the item stores */
+        version_back.store(span.pack, release_memory_order);
+        notify_back.notify(version_back, span.size());
+    }
+    
+    /*
+     * peek_front - claim up to n slots at the front to be read in place
+     *
+     * the slots belong to the caller until release() hands them back to the
+     * producers. returns an empty span if the queue is empty.
+     */
+    slot_span peek_front(size_t n = 1)
+    {
+        static_assert(layout_t::contiguous, "peek_front needs queue_layout_linear");
+        atomic_uint_t front = 0, pack = 0;
+        queue_status status;
+        
+        size_t count = claim_front(n, front, pack, status);
+        return make_span(front, count, pack);
+    }
+    
+    void release(const slot_span &span)
+    {
+        /* the release store of version_front orders the item loads */
+        version_front.store(span.pack, release_memory_order);
+        notify_front.notify(version_front, span.size());
+    }
+    
+    /*
+     * consume_all - claim every published item (up to max) and pass it to f in place
+     *
+     * snapshots version_back once, claims the whole range with one compare_exchange,
+     * calls f(item_t *first, size_t count) on each of the at most two contiguous runs
+     * and publishes version_front once. an empty queue or a zero max makes no call.
+     * returns the number of items consumed.
+     *
+     * f runs while the front is claimed, so with multiple consumers the others get
+     * queue_busy until it returns: keep it short and do not throw. an exception still
+     * releases the span (the claimed items count as consumed). item_t is std::atomic<T>
+     * under queue_storage_atomic; plain T runs need queue_storage_raw or _inline.
+     */
+    template <typename F>
+    size_t consume_all(F &&f, size_t max = SIZE_MAX)
+    {
+        struct release_guard
+        {
+            queue_atomic &queue;
+            const slot_span &span;
+            ~release_guard() { queue.release(span); }
+        };
+        
+        slot_span span = peek_front(max);
+        if (!span) return 0;
+        release_guard guard = { *this, span };
+        f(static_cast<item_t*>(span.first), span.first_count);
+        if (span.second_count) f(static_cast<item_t*>(span.second), span.second_count);
+        return span.size();
+    }
+    
+    /*
+     * push_back_n - push up to n items from the range starting at first
+     *
+     * claims the whole range with one compare_exchange and publishes version_back
+     * once. with the linear layout the claimed slots are split into at most two
+     * contiguous runs at the wrap-around point. returns the number of items pushed.
+     */
+    template <typename InputIt>
+    size_t push_back_n(InputIt first, size_t n)
+    {
+        atomic_uint_t back, pack;
+        queue_status status;
+        
+        size_t count = claim_back_overwrite(n, back, pack, status);
+        if (count == 0) return 0;
+        
+        if (layout_t::contiguous) {
+            slot_span span = make_span(back, count, pack);
+            first = storage_t::store_n(span.first, first, span.first_count, relaxed_memory_order);
+            storage_t::store_n(span.second, first, span.second_count, relaxed_memory_order);
+        } else {
+            for (size_t i = 0; i < count; i++, ++first) {
+                storage_t::store(slot(back + i), *first, relaxed_memory_order);
+            }
+        }
+        
+        version_back.store(pack, release_memory_order);
+        notify_back.notify(version_back, count);
+        return count;
+    }
+    
+    /*
+     * pop_front_n - pop up to n items into the range starting at first
+     *
+     * claims the whole range with one compare_exchange and publishes version_front
+     * once. returns the number of items popped.
+     */
+    template <typename OutputIt>
+    size_t pop_front_n(OutputIt first, size_t n)
+    {
+        atomic_uint_t front, pack;
+        queue_status status;
+        
+        size_t count = claim_front(n, front, pack, status);
+        if (count == 0) return 0;
+        
+        /* the acquire load of version_back in claim_front orders the item loads */
+        if (layout_t::contiguous) {
+            slot_span span = make_span(front, count, pack);
+            first = storage_t::load_n(span.first, first, span.first_count, relaxed_memory_order);
+            storage_t::load_n(span.second, first, span.second_count, relaxed_memory_order);
+        } else {
+            for (size_t i = 0; i < count; i++, ++first) {
+                *first = storage_t::load(slot(front + i), relaxed_memory_order);
+            }
+        }
+        
+        version_front.store(pack, release_memory_order);
+        notify_front.notify(version_front, count);
+        return count;
+    }
+    
+    /*
+     * push_back_wait - push an item, parking while the queue is full
+     *
+     * spins briefly then parks on version_front until a consumer publishes a new
+     * front. the _for and _until forms return false if the timeout expires.
+     */
+    bool push_back_wait(T elem)
+    {
+        return _push_back_wait(elem, nullptr);
+    }
+    
+    template <typename Rep, typename Period>
+    bool push_back_wait_for(T elem, const std::chrono::duration<Rep,Period> &rel_time)
+    {
+        auto deadline = std::chrono::steady_clock::now() + rel_time;
+        return _push_back_wait(elem, &deadline);
+    }
+    
+    template <typename Clock, typename Duration>
+    bool push_back_wait_until(T elem, const std::chrono::time_point<Clock,Duration> &abs_time)
+    {
+        auto deadline = std::chrono::steady_clock::now() + (abs_time - Clock::now());
+        return _push_back_wait(elem, &deadline);
+    }
+    
+    /*
+     * pop_front_wait - pop an item, parking while the queue is empty
+     *
+     * spins briefly then parks on version_back until a producer publishes a new
+     * back. the _for and _until forms return T(0) if the timeout expires.
+     */
+    T pop_front_wait()
+    {
+        return _pop_front_wait(nullptr);
+    }
+    
+    template <typename Rep, typename Period>
+    T pop_front_wait_for(const std::chrono::duration<Rep,Period> &rel_time)
+    {
+        auto deadline = std::chrono::steady_clock::now() + rel_time;
+        return _pop_front_wait(&deadline);
+    }
+    
+    template <typename Clock, typename Duration>
+    T pop_front_wait_until(const std::chrono::time_point<Clock,Duration> &abs_time)
+    {
+        auto deadline = std::chrono::steady_clock::now() + (abs_time - Clock::now());
+        return _pop_front_wait(&deadline);
+    }
+    
+    bool _push_back_wait(T elem, const std::chrono::steady_clock::time_point *deadline)
+    {
+        int spin_count = 0;
+        for (;;) {
+            /* snapshot front before the attempt so a pop in between is not missed */
+            atomic_uint_t _version_front = version_front.load(acquire_memory_order);
+            atomic_uint_t back, pack;
+            queue_status status;
+            if (claim_back_overwrite(1, back, pack, status)) {
+                storage_t::store(slot(back), elem, release_memory_order);
+                version_back.store(pack, release_memory_order);
+                notify_back.notify(version_back);
+                return true;
+            }
+            if (++spin_count < wait_spin_limit || !full()) continue;
+            if (!notify_front.wait(version_front, _version_front, deadline)) return false;
+        }
+    }
+    
+    T _pop_front_wait(const std::chrono::steady_clock::time_point *deadline)
+    {
+        int spin_count = 0;
+        for (;;) {
+            /* snapshot back before the attempt so a push in between is not missed */
+            atomic_uint_t _version_back = version_back.load(acquire_memory_order);
+            atomic_uint_t front, pack;
+            queue_status status;
+            if (claim_front(1, front, pack, status)) {
+                T val = storage_t::load(slot(front), acquire_memory_order);
+                version_front.store(pack, release_memory_order);
+                notify_front.notify(version_front);
+                return val;
+            }
+            if (++spin_count < wait_spin_limit || !empty()) continue;
+            if (!notify_back.wait(version_back, _version_back, deadline)) return T(0);
+        }
+    }
+};
+
+
+/*
+ * queue_atomic_seq
+ *
+ * Multiple producer multiple consumer queue template using per-slot sequence numbers.
+ *
+ *   - uses 2 shared atomic variables: counter_back and counter_front
+ *
+ *   - each slot carries a sequence number that says whether it is ready to be
+ *     written (seq == pos) or read (seq == pos + 1) at the position pos
+ *
+ *   - push_back and pop_front claim a position with a single compare_exchange
+ *     and complete their slot writes and reads concurrently, so a preempted
+ *     thread only delays the slot it claimed instead of the whole side
  *
+ *   - a slot that is claimed but not yet written (or read) is waited on with the
+ *     Backoff policy rather than reported as empty (or full)
  */
 
-#if defined(_MSC_VER)
-#define ALIGNED(x) __declspec(align(x))
-#elif defined(__GNUC__)
-#define ALIGNED(x) __attribute__((aligned(x)))
-#else
-#define ALIGNED(x)
-#endif
-
 template <typename T,
-          const int debug_contention = false,
           typename ATOMIC_UINT = uint64_t,
-          const int OFFSET_BITS = 48,
-          const int VERSION_BITS = 16,
-          std::memory_order relaxed_memory_order = std::memory_order_relaxed,
-          std::memory_order acquire_memory_order = std::memory_order_acquire,
-          std::memory_order release_memory_order = std::memory_order_release>
-struct queue_atomic
+          typename Backoff = queue_backoff_spin_yield<>>
+struct queue_atomic_seq
 {
     /* queue atomic type */
     
     typedef ATOMIC_UINT                         atomic_uint_t;
     typedef std::atomic<T>                      atomic_item_t;
+    typedef Backoff                             backoff_t;
+    typedef typename std::make_signed<atomic_uint_t>::type atomic_int_t;
     
-    
-    /* queue constants */
-    
-    static const int tight_spin_limit =         8;
-    static const int spin_limit =               1 << 24;
-    static const int debug_spin =               true;
-    static const int atomic_bits =              sizeof(atomic_uint_t) << 3;
-    static const int offset_bits =              OFFSET_BITS;
-    static const int version_bits =             VERSION_BITS;
-    static const int offset_shift =             0;
-    static const int version_shift =            offset_bits;
-    static const atomic_uint_t size_max =       (1ULL << (offset_bits - 1));
-    static const atomic_uint_t offset_limit =   (1ULL << offset_bits);
-    static const atomic_uint_t version_limit =  (1ULL << version_bits);
-    static const atomic_uint_t offset_mask =    (1ULL << offset_bits) - 1;
-    static const atomic_uint_t version_mask =   (1ULL << version_bits) - 1;
+    struct slot_t
+    {
+        std::atomic<atomic_uint_t> seq;
+        T item;
+    };
     
     
     /* queue storage */
     
-    ALIGNED(64) atomic_item_t *vec;
+    ALIGNED(64) slot_t *vec;
     const atomic_uint_t size_limit;
     ALIGNED(64) std::atomic<atomic_uint_t> counter_back;
-    std::atomic<atomic_uint_t> version_back;
     ALIGNED(64) std::atomic<atomic_uint_t> counter_front;
-    std::atomic<atomic_uint_t> version_front;
+    queue_notify_none notify;
     
     
     /* queue helpers */
     
     static inline bool ispow2(size_t val) { return val && !(val & (val-1)); }
     
-    /*
-     * pack a version number and an offset into an unsigned atomic integer
-     */
-    static inline const atomic_uint_t pack_offset(const atomic_uint_t version, const atomic_uint_t offset)
-    {
-        assert(version < version_limit);
-        assert(offset < offset_limit);
-        return (version << version_shift) | (offset << offset_shift);
-    }
-    
-    /*
-     * unpack a version number and offset and compare the version to a counter value
-     * returns true if the version in the counter matches the version packed in the offset
-     */
-    static inline bool unpack_offsets(const atomic_uint_t counter, const atomic_uint_t pack,
-                                      atomic_uint_t &offset)
-    {
-        if (((pack >> version_shift) & version_mask) == (counter & version_mask)) {
-            offset = (pack >> offset_shift) & offset_mask;
-            return true;
-        }
-        return false;
-    }
     
     /* queue implementation */
     
-    atomic_uint_t _back_version()   { return (version_back >> version_shift) & version_mask; }
-    atomic_uint_t _front_version()  { return (version_front >> version_shift) & version_mask; }
-    atomic_uint_t _back()           { return (version_back >> offset_shift) & offset_mask; }
-    atomic_uint_t _front()          { return (version_front >> offset_shift) & offset_mask; }
-    size_t capacity()               { return size_limit; }
-    
+    size_t capacity() { return size_limit; }
     
-    queue_atomic(size_t size_limit) :
+    queue_atomic_seq(size_t size_limit) :
         size_limit(size_limit),
         counter_back(0),
-        version_back(pack_offset(0, 0)),
-        counter_front(0),
-        version_front(pack_offset(0, size_limit))
+        counter_front(0)
     {
-        static_assert(version_bits + offset_bits <= atomic_bits,
-                      "version_bits + offset_bits must fit into atomic integer type");
         assert(size_limit > 0);
-        assert(size_limit <= size_max);
         assert(ispow2(size_limit));
-        vec = new atomic_item_t[size_limit]();
+        vec = new slot_t[size_limit]();
         assert(vec != nullptr);
+        for (size_t i = 0; i < size_limit; i++) {
+            vec[i].seq.store(i, std::memory_order_relaxed);
+        }
     }
     
-    virtual ~queue_atomic()
+    virtual ~queue_atomic_seq()
     {
         delete [] vec;
     }
     
-    bool empty()
-    {
-        atomic_uint_t back = (version_back >> offset_shift) & offset_mask;
-        atomic_uint_t front = (version_front >> offset_shift) & offset_mask;
-        
-        /* return true if queue is empty */
-        return (front - back == size_limit);
-    }
+    bool empty() { return size() == 0; }
     
-    bool full()
-    {
-        atomic_uint_t back = (version_back >> offset_shift) & offset_mask;
-        atomic_uint_t front = (version_front >> offset_shift) & offset_mask;
-
-        /* return true if queue is full */
-        return (front == back);
-    }
+    bool full() { return size() == size_limit; }
     
     size_t size()
     {
-        atomic_uint_t back = (version_back >> offset_shift) & offset_mask;
-        atomic_uint_t front = (version_front >> offset_shift) & offset_mask;
-
-        /* return queue size */
-        return size_limit - front + back;
+        /* load front first so back - front can not underflow */
+        atomic_uint_t front = counter_front.load(std::memory_order_acquire);
+        atomic_uint_t back = counter_back.load(std::memory_order_acquire);
+        
+        /* return queue size (approximate while claims are in flight) */
+        return back - front < size_limit ? back - front : size_limit;
     }
     
-    bool push_back(T elem)
+    template <typename... Args>
+    queue_status emplace_back(Args&&... args)
     {
-        atomic_uint_t back;
-        atomic_uint_t front = (version_front >> offset_shift) & offset_mask;
-
+        atomic_uint_t back = counter_back.load(std::memory_order_relaxed);
+        
         int spin_count = 0;
-        do {
-            /*
-             * if packed version equals counter_back then attempt push back
-             *
-             * this is where we detect if another thread is in the push back
-             * critical section and we only proceed if the versions are consistent:
-             *
-             *     i.e. counter_back == version_back >> version_shift & version_mask
-             */
-            atomic_uint_t _counter_back = counter_back.load(relaxed_memory_order);
-            atomic_uint_t _version_back = version_back.load(relaxed_memory_order);
-            if (unpack_offsets(_counter_back, _version_back, back))
-            {
-                /* if (full) return false; */
-                if (front == back) return false;
-                
-                /* create new back version */
-                atomic_uint_t new_back_version = (_counter_back + 1) & version_mask;
-                
-                /* calculate store offset and update back */
-                size_t offset = back++ & (size_limit - 1);
-                
-                /* pack new back version and back offset */
-                atomic_uint_t pack = pack_offset(new_back_version, back & (offset_limit - 1));
-                
-                /*
-                 * compare_exchange_weak and attempt to update the counter with the new version
-                 *
-                 * this is where we enter the critical section:
-                 *
-                 *     i.e. counter_back != version_back >> version_shift & version_mask
-                 *     for a brief number of instructions until we write the new version_back
-                 *
-                 * if successful other threads will spin until new version_back is visible
-                 * if successful we write the value followed by writing a new version_back
-                 * to leave the critical section
-                 */
-                if (counter_back.compare_exchange_weak(_counter_back, new_back_version, std::memory_order_acq_rel))
-                {
-                    vec[offset].store(elem, release_memory_order);
-
-                    /*
-                     * exit the critical section and reveal the new back offset to other threads
-                     *
-                     *    i.e. counter_front == version_front >> version_shift & version_mask
-                     */
-                    version_back.store(pack, release_memory_order);
-                    return true;
+        for (;;) {
+            slot_t &slot = vec[back & (size_limit - 1)];
+            atomic_uint_t seq = slot.seq.load(std::memory_order_acquire);
+            atomic_int_t dif = (atomic_int_t)(seq - back);
+            
+            if (dif == 0) {
+                /* slot is free at this position, claim the position */
+                if (counter_back.compare_exchange_weak(back, back + 1, std::memory_order_relaxed)) {
+                    slot.item = T(std::forward<Args>(args)...);
                     
-                } else if (debug_contention) {
-                    uint64_t _tsc = rdtsc();
-                    log_debug("%s version=%llu time=%llu spin_count=%d thread:%p phase 2 contention",
-                              __func__, _counter_back, _tsc, spin_count, std::this_thread::get_id());
+                    /* reveal the slot to the consumer of this position */
+                    slot.seq.store(back + 1, std::memory_order_release);
+                    return queue_ok;
                 }
+                /* back has been reloaded by the failed compare_exchange */
+            } else if (dif < 0) {
+                /* slot has not been consumed since the last lap: full unless a consumer has claimed it */
+                if (counter_front.load(std::memory_order_relaxed) + size_limit <= back) return queue_full;
             } else {
-                if (debug_contention) {
-                    uint64_t _tsc = rdtsc();
-                    log_debug("%s version=%llu time=%llu spin_count=%d thread:%p phase 1 contention",
-                              __func__, _counter_back, _tsc, spin_count, std::this_thread::get_id());
-                }
-            }
-
-            /*
-             * if we reach here then we detected an inconsistent version in phase 1 prepare
-             * or failed to update the counter to enter the critical section in phase 2
-             */
-
-            /* yield the thread before retrying */
-            if (spin_limit > tight_spin_limit) {
-                std::this_thread::yield();
+                /* another producer claimed this position */
+                back = counter_back.load(std::memory_order_relaxed);
             }
-            
-        } while (++spin_count < spin_limit);
-        
-        if (debug_spin) {
-            log_debug("%s thread:%p failed: reached spin limit", __func__, std::this_thread::get_id());
+            backoff_t::backoff(spin_count++, notify, counter_back, back);
         }
-        
-        return false;
     }
     
-    T pop_front()
+    queue_status try_push(const T &elem) { return emplace_back(elem); }
+    queue_status try_push(T &&elem)      { return emplace_back(std::move(elem)); }
+    bool push_back(const T &elem)        { return emplace_back(elem) == queue_ok; }
+    bool push_back(T &&elem)             { return emplace_back(std::move(elem)) == queue_ok; }
+    
+    queue_status try_pop(T &out)
     {
-        atomic_uint_t back = (version_back >> offset_shift) & offset_mask;
-        atomic_uint_t front;
+        atomic_uint_t front = counter_front.load(std::memory_order_relaxed);
         
         int spin_count = 0;
-        do {
-            /*
-             * if packed version equals counter_front then attempt pop front
-             *
-             * this is where we detect if another thread is in the pop front
-             * critical section and we only proceed if the versions are consistent:
-             *
-             *     i.e. counter_front == version_front >> version_shift & version_mask
-             */
-            atomic_uint_t _counter_front = counter_front.load(relaxed_memory_order);
-            atomic_uint_t _version_front = version_front.load(relaxed_memory_order);
-            if (unpack_offsets(_counter_front, _version_front, front))
-            {
-                /* if (empty) return nullptr; */
-                if (front - back == size_limit) return T(0);
-                
-                /* create new front version */
-                atomic_uint_t new_front_version = (_counter_front + 1) & version_mask;
-                
-                /* calculate offset and update front */
-                size_t offset = front++ & (size_limit - 1);
-                
-                /* pack new front version and front offset */
-                atomic_uint_t pack = pack_offset(new_front_version, front & (offset_limit - 1));
-                
-                /*
-                 * compare_exchange_weak and attempt to update the counter with the new version
-                 *
-                 * this is where we enter the critical section:
-                 *
-                 *     i.e. counter_front != version_front >> version_shift & version_mask
-                 *     for a brief number of instructions until we write the new version_front
-                 *
-                 * if successful other threads will spin until new version_front is visible
-                 * if successful we read the value followed by writing a new version_front
-                 * to leave the critical section
-                 */
-                if (counter_front.compare_exchange_weak(_counter_front, new_front_version, std::memory_order_acq_rel))
-                {
-                    T val = vec[offset].load(acquire_memory_order);
-                    
-                    /*
-                     * exit the critical section and reveal the new front offset to other threads
-                     *
-                     *    i.e. counter_front == version_front >> version_shift & version_mask
-                     */
-                    version_front.store(pack, release_memory_order);
-                    return val;
+        for (;;) {
+            slot_t &slot = vec[front & (size_limit - 1)];
+            atomic_uint_t seq = slot.seq.load(std::memory_order_acquire);
+            atomic_int_t dif = (atomic_int_t)(seq - (front + 1));
+            
+            if (dif == 0) {
+                /* slot is written at this position, claim the position */
+                if (counter_front.compare_exchange_weak(front, front + 1, std::memory_order_relaxed)) {
+                    out = std::move(slot.item);
                     
-                } else if (debug_contention) {
-                    uint64_t _tsc = rdtsc();
-                    log_debug("%s version=%llu time=%llu spin_count=%d thread:%p phase 2 contention",
-                              __func__, _counter_front, _tsc, spin_count, std::this_thread::get_id());
+                    /* release the slot to the producer of the next lap */
+                    slot.seq.store(front + size_limit, std::memory_order_release);
+                    return queue_ok;
                 }
+                /* front has been reloaded by the failed compare_exchange */
+            } else if (dif < 0) {
+                /* slot has not been written at this position: empty unless a producer has claimed it */
+                if (counter_back.load(std::memory_order_relaxed) <= front) return queue_empty;
             } else {
-                if (debug_contention) {
-                    uint64_t _tsc = rdtsc();
-                    log_debug("%s version=%llu time=%llu spin_count=%d thread:%p phase 1 contention",
-                              __func__, _counter_front, _tsc, spin_count, std::this_thread::get_id());
-                }
-            }
-            
-            /*
-             * if we reach here then we detected an inconsistent version in phase 1 prepare
-             * or failed to update the counter to enter the critical section in phase 2
-             */
-            
-            /* yield the thread before retrying */
-            if (spin_limit > tight_spin_limit) {
-                std::this_thread::yield();
+                /* another consumer claimed this position */
+                front = counter_front.load(std::memory_order_relaxed);
             }
-            
-        } while (++spin_count < spin_limit);
-        
-        if (debug_spin) {
-            log_debug("%s thread:%p failed: reached spin limit", __func__, std::this_thread::get_id());
+            backoff_t::backoff(spin_count++, notify, counter_front, front);
         }
-        
-        return T(0);
+    }
+    
+    T pop_front()
+    {
+        T val(0);
+        try_pop(val);
+        return val;
     }
 };
 
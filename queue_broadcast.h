@@ -0,0 +1,198 @@
+//
+//  queue_broadcast.h
+//
+
+#ifndef queue_broadcast_h
+#define queue_broadcast_h
+
+/*
+ * queue_broadcast
+ *
+ * Single producer multicast ring where every subscribed consumer reads every item.
+ *
+ *   - the producer publishes a monotonically increasing cursor; as in
+ *     queue_atomic the low bits are the slot offset and the high bits count
+ *     laps, so a stale cursor can never be mistaken for a current one
+ *
+ *   - each consumer owns a read cursor on its own cache line and the producer
+ *     is gated on the slowest consumer: it never writes a slot that an active
+ *     consumer has not passed (push_back returns false instead)
+ *
+ *   - the producer caches the gate and only rescans the consumer cursors when
+ *     the cached gate does not leave room for the push
+ *
+ *   - pop_front_n copies every published item up to n in one batch and
+ *     advances the consumer cursor once
+ *
+ *   - consumers subscribe at the current cursor and only see items pushed
+ *     after subscribing
+ */
+
+template <typename T,
+          template <typename> class Storage = queue_storage_raw>
+struct queue_broadcast
+{
+    /* queue types */
+    
+    typedef uint64_t                            atomic_uint_t;
+    typedef Storage<T>                          storage_t;
+    typedef typename storage_t::item_t          item_t;
+    
+    struct consumer_t
+    {
+        ALIGNED(64) std::atomic<atomic_uint_t> cursor;
+        std::atomic<bool> active;
+        
+        consumer_t() : cursor(0), active(false) {}
+    };
+    
+    
+    /* queue storage */
+    
+    ALIGNED(64) item_t *vec;
+    const atomic_uint_t size_limit;
+    consumer_t *consumers;
+    const size_t max_consumers;
+    ALIGNED(64) std::atomic<atomic_uint_t> cursor;
+    atomic_uint_t cached_gate;
+    std::mutex subscribe_mutex;
+    
+    
+    /* queue helpers */
+    
+    static inline bool ispow2(size_t val) { return val && !(val & (val-1)); }
+    
+    /* producer: lowest active consumer cursor, or the producer cursor if none */
+    atomic_uint_t gate(atomic_uint_t back)
+    {
+        /* pairs with the fence in subscribe: a scan that misses a new consumer is ordered before its start cursor */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        atomic_uint_t min = back;
+        for (size_t i = 0; i < max_consumers; i++) {
+            if (!consumers[i].active.load(std::memory_order_acquire)) continue;
+            atomic_uint_t c = consumers[i].cursor.load(std::memory_order_acquire);
+            if (c < min) min = c;
+        }
+        return min;
+    }
+    
+    /* producer: number of slots that can be written without passing the gate */
+    size_t writable(atomic_uint_t back, size_t n)
+    {
+        if (cached_gate + size_limit - back < n) {
+            cached_gate = gate(back);
+        }
+        size_t free = (size_t)(cached_gate + size_limit - back);
+        return n < free ? n : free;
+    }
+    
+    
+    /* queue implementation */
+    
+    queue_broadcast(size_t size_limit, size_t max_consumers = 16) :
+        size_limit(size_limit),
+        max_consumers(max_consumers),
+        cursor(0),
+        cached_gate(0)
+    {
+        assert(ispow2(size_limit));
+        vec = storage_t::allocate(size_limit);
+        /* cache line aligned so each consumer cursor has its own line */
+        consumers = queue_aligned_new_n<consumer_t>(max_consumers);
+    }
+    
+    virtual ~queue_broadcast()
+    {
+        storage_t::deallocate(vec, size_limit);
+        queue_aligned_delete_n(consumers, max_consumers);
+    }
+    
+    size_t capacity() { return size_limit; }
+    
+    /* returns a consumer id starting at the current cursor, or -1 if all are taken */
+    int subscribe()
+    {
+        std::lock_guard<std::mutex> lock(subscribe_mutex);
+        for (size_t i = 0; i < max_consumers; i++) {
+            consumer_t &c = consumers[i];
+            if (c.active.load(std::memory_order_relaxed)) continue;
+            /*
+             * activate at a cursor the producer has passed, which holds it back, then
+             * move to the producer cursor read after the fence: a gate scan that
+             * missed the activation was taken at or before that cursor, so the
+             * producer can not lap the new consumer with a stale cached gate
+             */
+            c.cursor.store(cursor.load(std::memory_order_acquire), std::memory_order_relaxed);
+            c.active.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            c.cursor.store(cursor.load(std::memory_order_acquire), std::memory_order_release);
+            return (int)i;
+        }
+        return -1;
+    }
+    
+    void unsubscribe(int id)
+    {
+        std::lock_guard<std::mutex> lock(subscribe_mutex);
+        consumers[id].active.store(false, std::memory_order_release);
+    }
+    
+    /* items published and not yet read by consumer id */
+    size_t size(int id)
+    {
+        return (size_t)(cursor.load(std::memory_order_acquire) -
+                        consumers[id].cursor.load(std::memory_order_relaxed));
+    }
+    
+    bool empty(int id) { return size(id) == 0; }
+    
+    bool push_back(const T &elem)
+    {
+        atomic_uint_t back = cursor.load(std::memory_order_relaxed);
+        if (writable(back, 1) == 0) return false;
+        storage_t::store(vec[back & (size_limit - 1)], elem, std::memory_order_relaxed);
+        cursor.store(back + 1, std::memory_order_release);
+        return true;
+    }
+    
+    /* push up to n items with one cursor publish, returns the number pushed */
+    template <typename InputIt>
+    size_t push_back_n(InputIt first, size_t n)
+    {
+        atomic_uint_t back = cursor.load(std::memory_order_relaxed);
+        size_t count = writable(back, n);
+        if (count == 0) return 0;
+        size_t offset = (size_t)(back & (size_limit - 1));
+        size_t first_count = count < size_limit - offset ? count : size_limit - offset;
+        first = storage_t::store_n(vec + offset, first, first_count, std::memory_order_relaxed);
+        storage_t::store_n(vec, first, count - first_count, std::memory_order_relaxed);
+        cursor.store(back + count, std::memory_order_release);
+        return count;
+    }
+    
+    queue_status try_pop(int id, T &out)
+    {
+        return pop_front_n(id, &out, 1) ? queue_ok : queue_empty;
+    }
+    
+    /* copy up to n published items for consumer id, returns the number read */
+    template <typename OutputIt>
+    size_t pop_front_n(int id, OutputIt first, size_t n)
+    {
+        consumer_t &c = consumers[id];
+        atomic_uint_t front = c.cursor.load(std::memory_order_relaxed);
+        size_t avail = (size_t)(cursor.load(std::memory_order_acquire) - front);
+        size_t count = n < avail ? n : avail;
+        if (count == 0) return 0;
+        size_t offset = (size_t)(front & (size_limit - 1));
+        size_t first_count = count < size_limit - offset ? count : size_limit - offset;
+        first = storage_t::load_n(vec + offset, first, first_count, std::memory_order_relaxed);
+        storage_t::load_n(vec, first, count - first_count, std::memory_order_relaxed);
+    
+        /* release the slots to the producer */
+        c.cursor.store(front + count, std::memory_order_release);
+        return count;
+    }
+};
+
+#endif
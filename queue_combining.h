@@ -0,0 +1,185 @@
+//
+//  queue_combining.h
+//
+
+#ifndef queue_combining_h
+#define queue_combining_h
+
+/*
+ * queue_combining
+ *
+ * Flat combining front end for a queue_atomic ring under heavy contention.
+ *
+ *   - a thread posts its push or pop request in a publication record (one
+ *     cache line each, picked by the dense thread index) and spins on it
+ *
+ *   - whichever thread takes the combiner flag scans the records and applies
+ *     all posted pushes with one push_back_n and then all posted pops with one
+ *     pop_front_n, so a whole batch costs one claim of the ring offsets, and
+ *     hands each requester its item and status
+ *
+ *   - only the combiner touches the ring, so the ring is single producer
+ *     single consumer by default (the combiner flag orders the hand over
+ *     between combiners)
+ *
+ *   - pushes of a batch are applied before its pops, so a pop can take an
+ *     item pushed in the same batch
+ *
+ *   - threads whose index maps to a record that is already in use move on
+ *     to the next free record
+ */
+
+template <typename T,
+          typename Queue = queue_atomic<T,false,uint64_t,48,16,
+                                        std::memory_order_relaxed,
+                                        std::memory_order_acquire,
+                                        std::memory_order_release,
+                                        queue_notify_none,
+                                        queue_backoff_spin_yield<>,
+                                        queue_spsc>,
+          const int max_threads = 64>
+struct queue_combining
+{
+    typedef Queue                               queue_t;
+    
+    static_assert((max_threads & (max_threads - 1)) == 0, "max_threads must be a power of 2");
+    
+    /* record states */
+    enum { record_free, record_owned, record_push, record_pop, record_done };
+    
+    struct record
+    {
+        ALIGNED(64) std::atomic<int> state;
+        queue_status status;
+        T item;
+    };
+    
+    
+    /* queue storage */
+    
+    queue_t queue;
+    record records[max_threads];
+    ALIGNED(64) std::atomic<bool> combining;
+    std::atomic<int> record_limit;
+    T push_batch[max_threads];
+    T pop_batch[max_threads];
+    record *push_records[max_threads];
+    record *pop_records[max_threads];
+    
+    
+    /* queue helpers */
+    
+    /* own a free record, starting at the one for this thread */
+    record& acquire()
+    {
+        unsigned home = queue_thread_index();
+        for (int spin_count = 0; ; spin_count++) {
+            for (int i = 0; i < max_threads; i++) {
+                int index = (int)((home + i) & (max_threads - 1));
+                record &r = records[index];
+                int state = record_free;
+                if (r.state.load(std::memory_order_relaxed) == record_free &&
+                    r.state.compare_exchange_strong(state, record_owned, std::memory_order_acquire)) {
+                    /* widen the range the combiner scans */
+                    int limit = record_limit.load(std::memory_order_relaxed);
+                    while (limit <= index && !record_limit.compare_exchange_weak(limit, index + 1,
+                                                                                 std::memory_order_relaxed)) {}
+                    return r;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+    
+    /* post a request and wait until a combiner (possibly this thread) applies it */
+    queue_status request(int op, T &item)
+    {
+        record &r = acquire();
+        if (op == record_push) r.item = item;
+        r.state.store(op, std::memory_order_release);
+    
+        for (int spin_count = 0; r.state.load(std::memory_order_acquire) != record_done; spin_count++) {
+            if (!combining.load(std::memory_order_relaxed) &&
+                !combining.exchange(true, std::memory_order_acquire)) {
+                combine();
+                combining.store(false, std::memory_order_release);
+            } else if (spin_count < 64) {
+                queue_cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    
+        queue_status status = r.status;
+        if (op == record_pop && status == queue_ok) item = std::move(r.item);
+        r.state.store(record_free, std::memory_order_release);
+        return status;
+    }
+    
+    /* combiner: apply every posted request with one batched push and one batched pop */
+    void combine()
+    {
+        size_t pushes = 0, pops = 0;
+        int limit = record_limit.load(std::memory_order_relaxed);
+        for (int i = 0; i < limit; i++) {
+            record &r = records[i];
+            int state = r.state.load(std::memory_order_acquire);
+            if (state == record_push) {
+                push_batch[pushes] = r.item;
+                push_records[pushes++] = &r;
+            } else if (state == record_pop) {
+                pop_records[pops++] = &r;
+            }
+        }
+    
+        if (pushes > 0) {
+            size_t count = queue.push_back_n(push_batch, pushes);
+            for (size_t i = 0; i < pushes; i++) {
+                push_records[i]->status = i < count ? queue_ok : queue_full;
+                push_records[i]->state.store(record_done, std::memory_order_release);
+            }
+        }
+        if (pops > 0) {
+            size_t count = queue.pop_front_n(pop_batch, pops);
+            for (size_t i = 0; i < pops; i++) {
+                if (i < count) pop_records[i]->item = std::move(pop_batch[i]);
+                pop_records[i]->status = i < count ? queue_ok : queue_empty;
+                pop_records[i]->state.store(record_done, std::memory_order_release);
+            }
+        }
+    }
+    
+    
+    /* queue implementation */
+    
+    queue_combining(size_t size_limit) : queue(size_limit), combining(false), record_limit(0)
+    {
+        for (int i = 0; i < max_threads; i++) {
+            records[i].state.store(record_free, std::memory_order_relaxed);
+        }
+    }
+    
+    virtual ~queue_combining() {}
+    
+    size_t capacity() { return queue.capacity(); }
+    
+    /* approximate while requests are in flight */
+    size_t size() { return queue.size(); }
+    
+    bool empty() { return size() == 0; }
+    
+    bool push_back(T elem) { return request(record_push, elem) == queue_ok; }
+    
+    queue_status try_push(T elem) { return request(record_push, elem); }
+    
+    queue_status try_pop(T &out) { return request(record_pop, out); }
+    
+    T pop_front()
+    {
+        T val(0);
+        try_pop(val);
+        return val;
+    }
+};
+
+#endif
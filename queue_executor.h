@@ -0,0 +1,182 @@
+//
+//  queue_executor.h
+//
+
+#ifndef queue_executor_h
+#define queue_executor_h
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*
+ * queue_executor
+ *
+ * Fixed pool of worker threads fed through a queue_atomic of task pointers.
+ *
+ *   - submit pushes one task and submit_n pushes a batch of tasks with
+ *     push_back_n, claiming many slots with one compare_exchange
+ *
+ *   - idle workers park in pop_front_wait (queue_notify_futex) instead of
+ *     spinning on empty pops, and the submit path only makes the wake
+ *     syscall when a worker is parked; submit wakes one worker and
+ *     submit_n one per task
+ *
+ *   - drain parks on a condition variable until every submitted task has
+ *     run, signalled by the worker that runs the last pending task; shutdown
+ *     drains and then stops the workers with one null task each (FIFO order
+ *     puts them behind all submitted tasks)
+ *
+ *   - workers can be pinned to a list of cpus (linux)
+ */
+
+/*
+ * queue_task - unit of work; run is called once on a worker thread and the
+ * task owns its own lifetime (queue_task_fn deletes itself after running)
+ */
+
+struct queue_task
+{
+    virtual ~queue_task() {}
+    virtual void run() = 0;
+};
+
+template <typename F>
+struct queue_task_fn : queue_task
+{
+    F f;
+    
+    template <typename G>
+    queue_task_fn(G &&g) : f(std::forward<G>(g)) {}
+    
+    void run()
+    {
+        f();
+        delete this;
+    }
+};
+
+template <typename Queue = queue_atomic<queue_task*,false,uint64_t,48,16,
+                                        std::memory_order_relaxed,
+                                        std::memory_order_acquire,
+                                        std::memory_order_release,
+                                        queue_notify_futex>>
+struct queue_executor
+{
+    typedef Queue                               queue_t;
+    
+    
+    /* executor storage */
+    
+    queue_t queue;
+    std::vector<std::thread> workers;
+    ALIGNED(64) std::atomic<size_t> pending;
+    std::atomic<bool> stopped;
+    std::mutex drain_mutex;
+    std::condition_variable drained;
+    
+    
+    /* executor implementation */
+    
+    /* cpus, when given, pins worker i to cpus[i % cpus.size()] */
+    queue_executor(size_t num_workers, size_t size_limit = 65536,
+                   const std::vector<int> &cpus = std::vector<int>()) :
+        queue(size_limit), pending(0), stopped(false)
+    {
+        assert(num_workers > 0);
+        for (size_t i = 0; i < num_workers; i++) {
+            workers.push_back(std::thread(&queue_executor::worker, this));
+            if (!cpus.empty()) pin(workers.back(), cpus[i % cpus.size()]);
+        }
+    }
+    
+    virtual ~queue_executor() { shutdown(); }
+    
+    static void pin(std::thread &thread, int cpu)
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+    }
+    
+    void worker()
+    {
+        for (;;) {
+            queue_task *task = queue.pop_front_wait();
+            if (!task) break;
+            task->run();
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                /* taking the lock orders the wake after the drainer's check */
+                std::lock_guard<std::mutex> lock(drain_mutex);
+                drained.notify_all();
+            }
+        }
+    }
+    
+    size_t num_workers() { return workers.size(); }
+    
+    /* submit a task, parking while the queue is full */
+    void submit(queue_task *task)
+    {
+        assert(task != nullptr);
+        pending.fetch_add(1, std::memory_order_relaxed);
+        queue.push_back_wait(task);
+    }
+    
+    /* submit a callable, wrapped in a heap allocated queue_task_fn */
+    template <typename F>
+    void submit(F &&f)
+    {
+        queue_task *task = new queue_task_fn<typename std::decay<F>::type>(std::forward<F>(f));
+        submit(task);
+    }
+    
+    /* submit n tasks, claiming as many slots as are free per compare_exchange */
+    void submit_n(queue_task **tasks, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            assert(tasks[i] != nullptr);
+        }
+        pending.fetch_add(n, std::memory_order_relaxed);
+        while (n > 0) {
+            size_t count = queue.push_back_n(tasks, n);
+            if (count == 0) {
+                /* full: park until one slot is free */
+                queue.push_back_wait(*tasks);
+                count = 1;
+            }
+            tasks += count;
+            n -= count;
+        }
+    }
+    
+    /* wait until every submitted task has run, parking after a short spin */
+    void drain()
+    {
+        for (int spin_count = 0; spin_count < 64; spin_count++) {
+            if (pending.load(std::memory_order_acquire) == 0) return;
+            queue_cpu_relax();
+        }
+        std::unique_lock<std::mutex> lock(drain_mutex);
+        drained.wait(lock, [this] { return pending.load(std::memory_order_acquire) == 0; });
+    }
+    
+    /* run the queued tasks then stop and join the workers */
+    void shutdown()
+    {
+        if (stopped.exchange(true)) return;
+        drain();
+        for (size_t i = 0; i < workers.size(); i++) {
+            queue.push_back_wait(nullptr);
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+};
+
+#endif
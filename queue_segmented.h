@@ -0,0 +1,299 @@
+//
+//  queue_segmented.h
+//
+
+#ifndef queue_segmented_h
+#define queue_segmented_h
+
+/*
+ * queue_segmented
+ *
+ * Unbounded multiple producer multiple consumer queue made of a linked list of
+ * fixed size queue_atomic ring segments, so memory follows the queue length
+ * instead of being allocated and zero filled for the peak up front.
+ *
+ *   - each segment accepts exactly segment_size pushes per use: producers take
+ *     a ticket with one fetch_add on claimed and push into the ring, which
+ *     cannot fill because it never holds more than segment_size items. the
+ *     producer that draws the first ticket past the end links the next segment
+ *     and moves the tail on
+ *
+ *   - consumers pop from the head segment and count pops; once all
+ *     segment_size items of the head segment have been popped the head moves
+ *     to the next segment and the drained segment is retired
+ *
+ *   - drained segments are sealed and recycled through a pool of spare
+ *     segments (a queue_atomic of segment pointers), so steady state pushes
+ *     and pops never allocate and cost the ring operation plus one fetch_add
+ *
+ *   - segments are type stable: a thread with a stale segment pointer only
+ *     ever touches a live segment or a sealed spare, which rejects tickets.
+ *     the slow paths that link or unlink segments take a reference count on
+ *     the segment and recheck it, and a retired segment is only sealed and
+ *     pooled once no thread holds a reference (without a lock: referenced
+ *     segments wait on a retired list for a later retire)
+ *
+ *   - spare segments are freed by shrink() while no other thread is using the
+ *     queue, and with the queue; push_back returns false only when
+ *     max_segments segments are in use
+ *
+ *   - like the version counters of queue_atomic this has an ABA window: a
+ *     consumer stalled for the whole time it takes to drain, recycle and
+ *     refill its segment can pop an item of the next use of that segment
+ *     ahead of older items
+ */
+
+template <typename T,
+          typename Segment = queue_atomic<T>>
+struct queue_segmented
+{
+    typedef Segment                             ring_t;
+    
+    struct segment_t
+    {
+        ring_t ring;
+        ALIGNED(64) std::atomic<size_t> claimed;
+        ALIGNED(64) std::atomic<size_t> popped;
+        ALIGNED(64) std::atomic<size_t> users;
+        std::atomic<segment_t*> next;
+        uint64_t first;
+    
+        segment_t(size_t segment_size) : ring(segment_size), claimed(sealed), popped(0),
+            users(0), next(nullptr), first(0) {}
+    };
+    
+    /* claimed of a spare segment; tickets at or past sealed are rejected */
+    static const size_t sealed =                (size_t)1 << (sizeof(size_t) * 8 - 2);
+    
+    
+    /* queue storage */
+    
+    ALIGNED(64) std::atomic<segment_t*> head;
+    ALIGNED(64) std::atomic<segment_t*> tail;
+    const size_t segment_size;
+    const size_t max_segments;
+    std::atomic<size_t> segments;
+    queue_atomic<segment_t*> pool;
+    queue_atomic<segment_t*> retired;
+    
+    
+    /* queue helpers */
+    
+    static inline bool ispow2(size_t val) { return val && !(val & (val-1)); }
+    
+    /* slow path: take a reference on the segment src points to, valid until leave */
+    segment_t* enter(std::atomic<segment_t*> &src)
+    {
+        segment_t *seg = src.load(std::memory_order_seq_cst);
+        for (;;) {
+            seg->users.fetch_add(1, std::memory_order_seq_cst);
+            segment_t *again = src.load(std::memory_order_seq_cst);
+            if (again == seg) return seg;
+            seg->users.fetch_sub(1, std::memory_order_release);
+            seg = again;
+        }
+    }
+    
+    static inline void leave(segment_t *seg)
+    {
+        seg->users.fetch_sub(1, std::memory_order_release);
+    }
+    
+    /* a sealed spare segment, or a new one unless max_segments are in use */
+    segment_t* allocate()
+    {
+        segment_t *seg = nullptr;
+        if (pool.try_pop(seg) == queue_ok) return seg;
+        if (segments.fetch_add(1, std::memory_order_relaxed) >= max_segments) {
+            segments.fetch_sub(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return queue_aligned_new<segment_t>(segment_size);
+    }
+    
+    /* seal an unused segment and return it to the pool (which has room for all) */
+    void recycle(segment_t *seg)
+    {
+        seg->claimed.store(sealed, std::memory_order_relaxed);
+        while (!pool.push_back(seg)) queue_cpu_relax();
+    }
+    
+    /* recycle an unlinked segment and any earlier retired segments no longer referenced */
+    void retire(segment_t *seg)
+    {
+        size_t count = retired.size() + 1;
+        while (!retired.push_back(seg)) queue_cpu_relax();
+        for (; count > 0; count--) {
+            if (retired.try_pop(seg) != queue_ok) break;
+            if (seg->users.load(std::memory_order_seq_cst) == 0) {
+                recycle(seg);
+            } else {
+                while (!retired.push_back(seg)) queue_cpu_relax();
+            }
+        }
+    }
+    
+    /* slow path: link the next segment after a used up tail segment and move the tail */
+    bool extend()
+    {
+        segment_t *seg = enter(tail);
+        size_t claimed = seg->claimed.load(std::memory_order_acquire);
+        if (claimed < segment_size || claimed >= sealed) {
+            /* the tail moved on and was refilled, or is still being unsealed */
+            leave(seg);
+            return true;
+        }
+        segment_t *next = seg->next.load(std::memory_order_acquire);
+        if (!next) {
+            segment_t *fresh = allocate();
+            if (!fresh) {
+                leave(seg);
+                return false;
+            }
+            fresh->popped.store(0, std::memory_order_relaxed);
+            fresh->next.store(nullptr, std::memory_order_relaxed);
+            fresh->first = seg->first + segment_size;
+            if (seg->next.compare_exchange_strong(next, fresh, std::memory_order_acq_rel,
+                                                  std::memory_order_acquire)) {
+                /* linked: unseal it for tickets */
+                fresh->claimed.store(0, std::memory_order_release);
+                next = fresh;
+            } else {
+                recycle(fresh);
+            }
+        }
+        segment_t *expected = seg;
+        tail.compare_exchange_strong(expected, next, std::memory_order_seq_cst);
+        leave(seg);
+        return true;
+    }
+    
+    /* slow path: move the head past a drained segment, returns false if there is none */
+    bool advance(segment_t *seg)
+    {
+        segment_t *pinned = enter(head);
+        if (pinned != seg) {
+            /* another consumer moved the head on */
+            leave(pinned);
+            return true;
+        }
+        segment_t *next = seg->next.load(std::memory_order_acquire);
+        if (!next || seg->popped.load(std::memory_order_acquire) < segment_size) {
+            leave(seg);
+            return false;
+        }
+    
+        /* the tail never stays behind the head, then unlink and retire the segment */
+        segment_t *expected = seg;
+        tail.compare_exchange_strong(expected, next, std::memory_order_seq_cst);
+        expected = seg;
+        bool unlinked = head.compare_exchange_strong(expected, next, std::memory_order_seq_cst);
+        leave(seg);
+        if (unlinked) retire(seg);
+        return true;
+    }
+    
+    
+    /* queue implementation */
+    
+    /* max_segments * segment_size bounds the queue length only to bound the pool */
+    queue_segmented(size_t segment_size = 1024, size_t max_segments = 16384) :
+        segment_size(segment_size),
+        max_segments(max_segments),
+        segments(1),
+        pool(max_segments),
+        retired(max_segments)
+    {
+        assert(ispow2(segment_size));
+        assert(ispow2(max_segments));
+        segment_t *seg = queue_aligned_new<segment_t>(segment_size);
+        seg->claimed.store(0, std::memory_order_relaxed);
+        head.store(seg, std::memory_order_relaxed);
+        tail.store(seg, std::memory_order_relaxed);
+    }
+    
+    virtual ~queue_segmented()
+    {
+        segment_t *seg = head.load(std::memory_order_relaxed);
+        while (seg) {
+            segment_t *next = seg->next.load(std::memory_order_relaxed);
+            queue_aligned_delete(seg);
+            seg = next;
+        }
+        shrink();
+        while (retired.try_pop(seg) == queue_ok) queue_aligned_delete(seg);
+    }
+    
+    /* free the spare segments; only while no other thread is using the queue */
+    void shrink()
+    {
+        segment_t *seg = nullptr;
+        while (pool.try_pop(seg) == queue_ok) {
+            queue_aligned_delete(seg);
+            segments.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    
+    /* approximate while pushes and pops are in flight */
+    size_t size()
+    {
+        segment_t *h = enter(head);
+        segment_t *t = enter(tail);
+        size_t claimed = t->claimed.load(std::memory_order_relaxed);
+        uint64_t back = t->first + (claimed < segment_size ? claimed : segment_size);
+        uint64_t front = h->first + h->popped.load(std::memory_order_relaxed);
+        leave(t);
+        leave(h);
+        return back > front ? (size_t)(back - front) : 0;
+    }
+    
+    bool empty() { return size() == 0; }
+    
+    /* links a segment when the tail segment is used up; false only at max_segments */
+    bool push_back(const T &elem)
+    {
+        for (;;) {
+            segment_t *seg = tail.load(std::memory_order_acquire);
+            size_t ticket = seg->claimed.fetch_add(1, std::memory_order_acquire);
+            if (ticket < segment_size) {
+                /* the ring holds at most segment_size items so only contention can fail this */
+                while (seg->ring.try_push(elem) != queue_ok) queue_cpu_relax();
+                return true;
+            }
+            if (ticket >= sealed) {
+                /* a stale tail that was recycled, or a new tail not yet unsealed */
+                queue_cpu_relax();
+                continue;
+            }
+            if (!extend()) return false;
+        }
+    }
+    
+    /*
+     * try_pop - pop from the head segment, moving on when it has been drained
+     *
+     * returns queue_busy if the head ring spin limit was reached under contention
+     */
+    queue_status try_pop(T &out)
+    {
+        for (;;) {
+            segment_t *seg = head.load(std::memory_order_acquire);
+            queue_status status = seg->ring.try_pop(out);
+            if (status == queue_ok) {
+                seg->popped.fetch_add(1, std::memory_order_release);
+                return queue_ok;
+            }
+            if (status == queue_busy) return queue_busy;
+            if (!advance(seg)) return queue_empty;
+        }
+    }
+    
+    T pop_front()
+    {
+        T val(0);
+        try_pop(val);
+        return val;
+    }
+};
+
+#endif
@@ -0,0 +1,152 @@
+//
+//  queue_sharded.h
+//
+
+#ifndef queue_sharded_h
+#define queue_sharded_h
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+/*
+ * queue_sharded
+ *
+ * Multiple producer multiple consumer queue made of lane_count independent
+ * queue_atomic lanes so producers do not all serialize on one counter_back.
+ *
+ *   - push_back goes to the home lane of the calling thread (Home policy) and
+ *     spills to the following lanes only when the home lane is full
+ *
+ *   - try_pop and pop_front drain the home lane first then scan the other
+ *     lanes in order, stealing from whichever lane has items
+ *
+ *   - ordering is relaxed: items are FIFO within a lane only, so items from
+ *     one producer stay in order unless they spill to another lane, and there
+ *     is no global FIFO order between lanes
+ *
+ *   - size() sums the lane sizes without a common snapshot and is approximate
+ *     while pushes and pops are in flight
+ */
+
+/*
+ * home lane policies
+ *
+ * queue_lane_thread uses the dense thread index (stable for a thread).
+ * queue_lane_cpu uses the current cpu (sched_getcpu on linux), which keeps
+ * threads on the same core on the same lane but may move when a thread migrates.
+ */
+
+struct queue_lane_thread
+{
+    static inline unsigned home() { return queue_thread_index(); }
+};
+
+struct queue_lane_cpu
+{
+    static inline unsigned home()
+    {
+#if defined(__linux__)
+        int cpu = sched_getcpu();
+        if (cpu >= 0) return (unsigned)cpu;
+#endif
+        return queue_thread_index();
+    }
+};
+
+template <typename T,
+          typename Lane = queue_atomic<T>,
+          typename Home = queue_lane_thread>
+struct queue_sharded
+{
+    typedef Lane                                lane_t;
+    typedef Home                                home_t;
+    
+    
+    /* queue storage */
+    
+    lane_t **lanes;
+    const size_t lane_count;
+    const size_t size_limit;
+    
+    
+    /* queue helpers */
+    
+    static inline bool ispow2(size_t val) { return val && !(val & (val-1)); }
+    
+    inline size_t home_lane() { return home_t::home() & (lane_count - 1); }
+    
+    
+    /* queue implementation */
+    
+    /* size_limit is the total capacity, split evenly over lane_count lanes */
+    queue_sharded(size_t size_limit, size_t lane_count = 8) :
+        lane_count(lane_count),
+        size_limit(size_limit)
+    {
+        assert(ispow2(lane_count));
+        assert(ispow2(size_limit));
+        assert(size_limit >= lane_count);
+        lanes = new lane_t*[lane_count];
+        for (size_t i = 0; i < lane_count; i++) {
+            lanes[i] = queue_aligned_new<lane_t>(size_limit / lane_count);
+        }
+    }
+    
+    virtual ~queue_sharded()
+    {
+        for (size_t i = 0; i < lane_count; i++) {
+            queue_aligned_delete(lanes[i]);
+        }
+        delete [] lanes;
+    }
+    
+    size_t capacity() { return size_limit; }
+    
+    bool empty() { return size() == 0; }
+    
+    size_t size()
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < lane_count; i++) {
+            size += lanes[i]->size();
+        }
+        return size;
+    }
+    
+    bool push_back(const T &elem)
+    {
+        size_t home = home_lane();
+        for (size_t i = 0; i < lane_count; i++) {
+            if (lanes[(home + i) & (lane_count - 1)]->push_back(elem)) return true;
+        }
+        return false;
+    }
+    
+    /*
+     * try_pop - pop from the home lane, otherwise steal from the other lanes
+     *
+     * returns queue_busy rather than queue_empty if a lane was skipped because
+     * its spin limit was reached
+     */
+    queue_status try_pop(T &out)
+    {
+        size_t home = home_lane();
+        queue_status result = queue_empty;
+        for (size_t i = 0; i < lane_count; i++) {
+            queue_status status = lanes[(home + i) & (lane_count - 1)]->try_pop(out);
+            if (status == queue_ok) return queue_ok;
+            if (status == queue_busy) result = queue_busy;
+        }
+        return result;
+    }
+    
+    T pop_front()
+    {
+        T val(0);
+        try_pop(val);
+        return val;
+    }
+};
+
+#endif
@@ -0,0 +1,244 @@
+//
+//  queue_shm.h
+//
+
+#ifndef queue_shm_h
+#define queue_shm_h
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * queue_shm
+ *
+ * queue_atomic in one position independent shared memory block, so separate
+ * processes can exchange items through it without copying them through the
+ * kernel.
+ *
+ *   - the block holds a header (magic, layout version, capacity, element
+ *     size and queue size), then the queue_atomic control words, then the
+ *     slots; the queue's slot pointer is a queue_offset_ptr relative to its
+ *     own address so each process can map the block at a different address
+ *
+ *   - create sizes and initializes the block in a POSIX shared memory object
+ *     (shm_open) or an existing file descriptor such as a memfd, attach maps
+ *     an existing block and checks its header against the expected layout
+ *
+ *   - the queue is used through operator-> with the usual push_back, try_pop
+ *     and pop_front calls; slots use queue_storage_atomic by default, which
+ *     is only address free for lock-free std::atomic<T>, or
+ *     queue_storage_inline for trivially copyable payloads
+ *
+ *   - Notify is queue_notify_none: waiting threads spin and yield, because
+ *     the futex words of queue_notify_futex are process private
+ *
+ *   - the queue in the block has no vtable pointer (see queue_base), so
+ *     processes running different binaries can attach to the same block
+ */
+
+/*
+ * queue_offset_ptr - pointer stored as an offset from its own address, valid
+ * in every process that maps the block holding both the pointer and target
+ */
+
+template <typename T>
+struct queue_offset_ptr
+{
+    intptr_t offset;
+    
+    queue_offset_ptr(T *ptr = nullptr) { *this = ptr; }
+    queue_offset_ptr(const queue_offset_ptr &other) { *this = (T*)other; }
+    
+    queue_offset_ptr& operator=(T *ptr)
+    {
+        offset = ptr ? (char*)ptr - (char*)this : 0;
+        return *this;
+    }
+    
+    queue_offset_ptr& operator=(const queue_offset_ptr &other) { return *this = (T*)other; }
+    
+    operator T*() const { return offset ? (T*)((char*)this + offset) : nullptr; }
+};
+
+/*
+ * queue_storage_shared<Storage>::policy - Storage with a queue_offset_ptr slot
+ * pointer; the slots belong to the shared memory block, not the queue
+ */
+
+template <template <typename> class Storage = queue_storage_atomic>
+struct queue_storage_shared
+{
+    template <typename T>
+    struct policy : Storage<T>
+    {
+        typedef typename Storage<T>::item_t item_t;
+        typedef queue_offset_ptr<item_t> pointer_t;
+    
+        static void deallocate(item_t *, size_t) {}
+    };
+};
+
+struct queue_shm_header
+{
+    static const uint64_t shm_magic =           0x6d68736575657571ULL; /* "queueshm" */
+    static const uint32_t shm_version =         2;
+    
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t capacity;
+    uint64_t element_size;
+    uint64_t queue_size;
+    uint64_t map_size;
+};
+
+template <typename T,
+          typename Cardinality = queue_mpmc,
+          template <typename> class Storage = queue_storage_atomic>
+struct queue_shm
+{
+    typedef queue_atomic<T,false,uint64_t,48,16,
+                         std::memory_order_relaxed,
+                         std::memory_order_acquire,
+                         std::memory_order_release,
+                         queue_notify_none,
+                         queue_backoff_spin_yield<>,
+                         Cardinality,
+                         queue_storage_shared<Storage>::template policy> queue_t;
+    typedef typename queue_t::item_t            item_t;
+    typedef queue_shm_header                    header_t;
+    
+    /* block layout: header, queue control words, slots, each on a cache line */
+    static const size_t queue_offset =          (sizeof(header_t) + 63) & ~(size_t)63;
+    static const size_t slots_offset =          queue_offset + ((sizeof(queue_t) + 63) & ~(size_t)63);
+    
+    static_assert(!std::is_polymorphic<queue_t>::value,
+                  "a queue in shared memory must not hold a vtable pointer");
+    
+    
+    /* mapping */
+    
+    char *base;
+    size_t map_size;
+    int fd;
+    
+    
+    /* mapping helpers */
+    
+    static inline bool ispow2(size_t val) { return val && !(val & (val-1)); }
+    
+    static size_t block_size(size_t size_limit) { return slots_offset + size_limit * sizeof(item_t); }
+    
+    header_t* header() { return reinterpret_cast<header_t*>(base); }
+    queue_t* queue() { return reinterpret_cast<queue_t*>(base + queue_offset); }
+    
+    bool map(int map_fd, size_t size)
+    {
+        void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, map_fd, 0);
+        if (mem == MAP_FAILED) return false;
+        base = static_cast<char*>(mem);
+        map_size = size;
+        fd = map_fd;
+        return true;
+    }
+    
+    
+    /* mapping implementation */
+    
+    queue_shm() : base(nullptr), map_size(0), fd(-1) {}
+    
+    virtual ~queue_shm() { detach(); }
+    
+    /*
+     * size and initialize a new block in map_fd, detaching any previous block.
+     * the handle owns map_fd from then on and closes it if this fails.
+     */
+    bool create(int map_fd, size_t size_limit)
+    {
+        assert(ispow2(size_limit));
+        detach();
+        size_t size = block_size(size_limit);
+        if (ftruncate(map_fd, (off_t)size) != 0 || !map(map_fd, size)) {
+            close(map_fd);
+            return false;
+        }
+    
+        item_t *slots = reinterpret_cast<item_t*>(base + slots_offset);
+        for (size_t i = 0; i < size_limit; i++) new (slots + i) item_t();
+        new (queue()) queue_t(size_limit, slots);
+    
+        header_t *h = header();
+        h->version = header_t::shm_version;
+        h->header_size = sizeof(header_t);
+        h->capacity = size_limit;
+        h->element_size = sizeof(item_t);
+        h->queue_size = sizeof(queue_t);
+        h->map_size = size;
+    
+        /* publish the magic last so an attach never sees a half built block */
+        h->magic.store(header_t::shm_magic, std::memory_order_release);
+        return true;
+    }
+    
+    /*
+     * map an existing block from map_fd, detaching any previous block. the
+     * handle owns map_fd from then on and closes it if this fails.
+     */
+    bool attach(int map_fd)
+    {
+        detach();
+        struct stat st;
+        if (fstat(map_fd, &st) != 0 || (size_t)st.st_size < slots_offset ||
+            !map(map_fd, (size_t)st.st_size)) {
+            close(map_fd);
+            return false;
+        }
+    
+        header_t *h = header();
+        bool valid = h->magic.load(std::memory_order_acquire) == header_t::shm_magic &&
+                     h->version == header_t::shm_version &&
+                     h->header_size == sizeof(header_t) &&
+                     h->element_size == sizeof(item_t) &&
+                     h->queue_size == sizeof(queue_t) &&
+                     h->map_size == map_size &&
+                     h->map_size == block_size(h->capacity);
+        if (!valid) detach();
+        return valid;
+    }
+    
+    /* create a named POSIX shared memory object, failing if it exists */
+    bool create(const char *name, size_t size_limit)
+    {
+        int map_fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (map_fd < 0) return false;
+        if (create(map_fd, size_limit)) return true;
+        shm_unlink(name);
+        return false;
+    }
+    
+    bool attach(const char *name)
+    {
+        int map_fd = shm_open(name, O_RDWR, 0);
+        if (map_fd < 0) return false;
+        return attach(map_fd);
+    }
+    
+    static void unlink(const char *name) { shm_unlink(name); }
+    
+    void detach()
+    {
+        if (base) munmap(base, map_size);
+        if (fd >= 0) close(fd);
+        base = nullptr;
+        map_size = 0;
+        fd = -1;
+    }
+    
+    bool attached() { return base != nullptr; }
+    
+    queue_t* operator->() { return queue(); }
+};
+
+#endif
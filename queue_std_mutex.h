@@ -39,15 +39,23 @@ struct queue_std_mutex
         return true;
     }
     
-    T pop_front()
+    queue_status try_pop(T &out)
     {
+        queue_status status = queue_empty;
         queue_mutex.lock();
-        T result(0);
         if (queue.size() > 0) {
-            result = queue.front();
+            out = std::move(queue.front());
             queue.pop();
+            status = queue_ok;
         }
         queue_mutex.unlock();
+        return status;
+    }
+    
+    T pop_front()
+    {
+        T result(0);
+        try_pop(result);
         return result;
     }
 };
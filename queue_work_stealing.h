@@ -0,0 +1,169 @@
+//
+//  queue_work_stealing.h
+//
+
+#ifndef queue_work_stealing_h
+#define queue_work_stealing_h
+
+/*
+ * queue_work_stealing
+ *
+ * Chase-Lev work-stealing deque (with the C11 memory orders of Le et al.)
+ *
+ *   - one owner thread calls push_bottom and pop_bottom, which only need a
+ *     compare_exchange when they race a thief for the last item
+ *
+ *   - any number of thief threads call steal, which takes the oldest item
+ *     from the top with one compare_exchange on top
+ *
+ *   - the circular buffer doubles when full; buffers that thieves may still
+ *     be reading are retired to a list and freed with the deque
+ *
+ *   - T is stored in std::atomic<T> slots so T should be a small trivially
+ *     copyable type such as a task pointer
+ */
+
+template <typename T>
+struct queue_work_stealing
+{
+    typedef int64_t                             index_t;
+    
+    struct buffer_t
+    {
+        const index_t size_limit;
+        std::atomic<T> *vec;
+        buffer_t *retired;
+    
+        buffer_t(index_t size_limit) : size_limit(size_limit), retired(nullptr)
+        {
+            vec = new std::atomic<T>[size_limit];
+        }
+    
+        ~buffer_t() { delete [] vec; }
+    
+        inline T load(index_t i) { return vec[i & (size_limit - 1)].load(std::memory_order_relaxed); }
+        inline void store(index_t i, T elem) { vec[i & (size_limit - 1)].store(elem, std::memory_order_relaxed); }
+    };
+    
+    
+    /* queue storage */
+    
+    ALIGNED(64) std::atomic<index_t> top;
+    ALIGNED(64) std::atomic<index_t> bottom;
+    std::atomic<buffer_t*> buffer;
+    
+    
+    /* queue helpers */
+    
+    static inline bool ispow2(size_t val) { return val && !(val & (val-1)); }
+    
+    /* owner only: double the buffer, keeping the old one alive for thieves */
+    buffer_t* grow(buffer_t *old, index_t b, index_t t)
+    {
+        buffer_t *next = new buffer_t(old->size_limit << 1);
+        for (index_t i = t; i < b; i++) {
+            next->store(i, old->load(i));
+        }
+        next->retired = old;
+        buffer.store(next, std::memory_order_release);
+        return next;
+    }
+    
+    
+    /* queue implementation */
+    
+    queue_work_stealing(size_t size_limit = 1024) : top(0), bottom(0)
+    {
+        assert(ispow2(size_limit));
+        buffer.store(new buffer_t((index_t)size_limit), std::memory_order_relaxed);
+    }
+    
+    virtual ~queue_work_stealing()
+    {
+        buffer_t *b = buffer.load(std::memory_order_relaxed);
+        while (b) {
+            buffer_t *retired = b->retired;
+            delete b;
+            b = retired;
+        }
+    }
+    
+    size_t capacity() { return (size_t)buffer.load(std::memory_order_relaxed)->size_limit; }
+    
+    /* approximate while thieves are active */
+    size_t size()
+    {
+        index_t b = bottom.load(std::memory_order_relaxed);
+        index_t t = top.load(std::memory_order_relaxed);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+    
+    bool empty() { return size() == 0; }
+    
+    /* owner: push to the bottom, growing the buffer if it is full */
+    void push_bottom(T elem)
+    {
+        index_t b = bottom.load(std::memory_order_relaxed);
+        index_t t = top.load(std::memory_order_acquire);
+        buffer_t *a = buffer.load(std::memory_order_relaxed);
+        if (b - t > a->size_limit - 1) {
+            a = grow(a, b, t);
+        }
+        a->store(b, elem);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    
+    /* owner: pop the newest item from the bottom */
+    queue_status pop_bottom(T &out)
+    {
+        index_t b = bottom.load(std::memory_order_relaxed) - 1;
+        buffer_t *a = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        index_t t = top.load(std::memory_order_relaxed);
+    
+        if (t > b) {
+            /* empty */
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return queue_empty;
+        }
+    
+        T elem = a->load(b);
+        if (t == b) {
+            /* last item: race the thieves for it */
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                   std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            if (!won) return queue_empty;
+        }
+        out = elem;
+        return queue_ok;
+    }
+    
+    /*
+     * thief: steal the oldest item from the top
+     *
+     * returns queue_busy if another thief or the owner took the item first,
+     * in which case the caller may retry or move on to another deque
+     */
+    queue_status steal(T &out)
+    {
+        index_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        index_t b = bottom.load(std::memory_order_acquire);
+    
+        if (t >= b) return queue_empty;
+    
+        buffer_t *a = buffer.load(std::memory_order_acquire);
+        T elem = a->load(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            return queue_busy;
+        }
+        out = elem;
+        return queue_ok;
+    }
+};
+
+#endif
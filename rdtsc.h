@@ -52,8 +52,111 @@ static __inline__ unsigned long long rdtsc(void)
     return ( (unsigned long long)lo)|( ((unsigned long long)hi)<<32 );
 }
 
+/* rdtscp waits for prior instructions to retire before reading the counter */
+static __inline__ unsigned long long rdtscp(void)
+{
+    unsigned hi, lo, aux;
+    __asm__ __volatile__ ("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux) :: "memory");
+    return ( (unsigned long long)lo)|( ((unsigned long long)hi)<<32 );
+}
+
+static __inline__ void rdtsc_lfence(void)
+{
+    __asm__ __volatile__ ("lfence" ::: "memory");
+}
+
+#define RDTSC_HAS_SERIALIZED 1
+
+#elif defined(__aarch64__)
+
+/* the generic timer virtual count, which runs at cntfrq_el0 rather than the cpu clock */
+static __inline__ unsigned long long rdtsc(void)
+{
+    unsigned long long x;
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r"(x));
+    return x;
+}
+
+static __inline__ void rdtsc_lfence(void)
+{
+    __asm__ __volatile__ ("isb" ::: "memory");
+}
+
+static __inline__ unsigned long long rdtscp(void)
+{
+    rdtsc_lfence();
+    return rdtsc();
+}
+
+static __inline__ unsigned long long rdtsc_frequency(void)
+{
+    unsigned long long x;
+    __asm__ __volatile__ ("mrs %0, cntfrq_el0" : "=r"(x));
+    return x;
+}
+
+#define RDTSC_HAS_SERIALIZED 1
+#define RDTSC_HAS_FREQUENCY 1
+
 #endif
 
 #endif
 
+#if RDTSC_HAS_SERIALIZED
+
+/*
+ * rdtsc_begin and rdtsc_end bracket a timed region
+ *
+ * begin keeps earlier instructions from drifting into the region and end
+ * waits for the region to retire before reading the counter, and keeps later
+ * instructions from starting before the read.
+ */
+
+static inline unsigned long long rdtsc_begin(void)
+{
+    rdtsc_lfence();
+    unsigned long long t = rdtsc();
+    rdtsc_lfence();
+    return t;
+}
+
+static inline unsigned long long rdtsc_end(void)
+{
+    unsigned long long t = rdtscp();
+    rdtsc_lfence();
+    return t;
+}
+
+/*
+ * rdtsc_ticks_per_ns - counter ticks per nanosecond
+ *
+ * read from cntfrq_el0 on aarch64, otherwise calibrated once against
+ * std::chrono::steady_clock over calibrate_ms (assumes an invariant tsc)
+ */
+
+static inline double rdtsc_ticks_per_ns(int calibrate_ms = 50)
+{
+    static double ticks_per_ns = 0;
+    if (ticks_per_ns > 0) return ticks_per_ns;
+#if RDTSC_HAS_FREQUENCY
+    ticks_per_ns = (double)rdtsc_frequency() / 1e9;
+#else
+    const auto t1 = std::chrono::steady_clock::now();
+    const unsigned long long c1 = rdtsc_begin();
+    while (std::chrono::steady_clock::now() - t1 < std::chrono::milliseconds(calibrate_ms)) {}
+    const auto t2 = std::chrono::steady_clock::now();
+    const unsigned long long c2 = rdtsc_end();
+    ticks_per_ns = (double)(c2 - c1) /
+        (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+#endif
+    return ticks_per_ns;
+}
+
+static inline double rdtsc_to_ns(unsigned long long ticks)
+{
+    return (double)ticks / rdtsc_ticks_per_ns();
+}
+
+#endif
+
 #endif /* rdtsc_h */
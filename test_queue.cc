@@ -4,22 +4,49 @@
 
 #include <cstdio>
 #include <cstdint>
+#include <cstdlib>
 #include <cstdarg>
 #include <cassert>
+#include <cstring>
+#include <ctime>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <memory>
+#include <new>
 #include <chrono>
 #include <vector>
 #include <queue>
 #include <set>
+#include <future>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <linux/perf_event.h>
+#endif
 
 extern void log_debug(const char* fmt, ...);
 
 #include "rdtsc.h"
 #include "queue_atomic.h"
 #include "queue_std_mutex.h"
+#include "queue_sharded.h"
+#include "queue_work_stealing.h"
+#include "queue_executor.h"
+#include "queue_broadcast.h"
+#include "queue_segmented.h"
+#include "queue_combining.h"
+#if defined(__linux__)
+#include "queue_shm.h"
+#endif
 
 using namespace std::chrono;
 
@@ -49,6 +76,178 @@ void log_debug(const char* fmt, ...)
 }
 
 
+/*
+ * perf_counters
+ *
+ * optional hardware counters around each benchmark run (test_queue --perf).
+ * the events are opened as one perf_event_open group led by the first event
+ * that opens, with inherit set so the worker threads started inside a run
+ * are counted. events that can not be opened print as "-" and if none can
+ * be opened the columns are left out and the benchmarks still run.
+ */
+
+struct perf_sample
+{
+    enum { cycles, instructions, l1d_misses, llc_misses, context_switches, count };
+    
+    double value[count];
+    
+    perf_sample operator-(const perf_sample &o) const
+    {
+        perf_sample d;
+        for (int i = 0; i < count; i++) d.value[i] = value[i] - o.value[i];
+        return d;
+    }
+};
+
+struct perf_counters
+{
+    int fd[perf_sample::count];
+    bool enabled;
+    
+    perf_counters() : enabled(false) { for (int i = 0; i < perf_sample::count; i++) fd[i] = -1; }
+    
+    ~perf_counters()
+    {
+#if defined(__linux__)
+        for (int i = 0; i < perf_sample::count; i++) if (fd[i] >= 0) close(fd[i]);
+#endif
+    }
+    
+#if defined(__linux__)
+    static int open_event(uint32_t type, uint64_t config, int group_fd)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = group_fd < 0;
+        attr.inherit = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+        if (fd < 0 && errno == EACCES) {
+            /* perf_event_paranoid may only allow user space counting */
+            attr.exclude_kernel = 1;
+            fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+        }
+        return fd;
+    }
+#endif
+    
+    bool open()
+    {
+#if defined(__linux__)
+        static const struct { uint32_t type; uint64_t config; } events[perf_sample::count] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+        };
+        int leader = -1;
+        for (int i = 0; i < perf_sample::count; i++) {
+            fd[i] = open_event(events[i].type, events[i].config, leader);
+            if (leader < 0) leader = fd[i];
+        }
+        enabled = leader >= 0;
+        if (!enabled) printf("# perf events unavailable: %s\n", strerror(errno));
+#endif
+        return enabled;
+    }
+    
+    int leader() const
+    {
+        for (int i = 0; i < perf_sample::count; i++) if (fd[i] >= 0) return fd[i];
+        return -1;
+    }
+    
+    void start()
+    {
+#if defined(__linux__)
+        if (!enabled) return;
+        ioctl(leader(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+    
+    /* read the running counts, scaled if the group was multiplexed */
+    perf_sample sample()
+    {
+        perf_sample s;
+        for (int i = 0; i < perf_sample::count; i++) {
+            s.value[i] = -1;
+#if defined(__linux__)
+            uint64_t buf[3];
+            if (fd[i] >= 0 && read(fd[i], buf, sizeof(buf)) == (ssize_t)sizeof(buf)) {
+                s.value[i] = buf[2] ? (double)buf[0] * (double)buf[1] / (double)buf[2] : 0;
+            }
+#endif
+        }
+        return s;
+    }
+    
+    void heading()
+    {
+        if (enabled) {
+            printf(" %-9s %-9s %-9s %-9s %-9s", "cyc/op", "ins/op", "l1d/op", "llc/op", "cs/op");
+        }
+        printf("\n");
+    }
+    
+    void print(const perf_sample &s, u64 op_count)
+    {
+        if (enabled) {
+            for (int i = 0; i < perf_sample::count; i++) {
+                if (fd[i] >= 0) printf(" %-9.3lf", s.value[i] / (double)op_count);
+                else printf(" %-9s", "-");
+            }
+        }
+        printf("\n");
+    }
+};
+
+static perf_counters perf;
+
+
+template <typename T, typename Notify, typename Backoff, typename Cardinality = queue_mpmc>
+using queue_atomic_policy = queue_atomic<T,false,uint64_t,48,16,
+    std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+    Notify,Backoff,Cardinality>;
+
+template <typename T, template <typename> class Storage>
+using queue_atomic_storage = queue_atomic<T,false,uint64_t,48,16,
+    std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+    queue_notify_none,queue_backoff_spin_yield<>,queue_mpmc,Storage>;
+
+template <size_t N>
+struct test_frame
+{
+    u64 seq;
+    char payload[N - sizeof(u64)];
+};
+
+template <typename T, typename Cardinality>
+using queue_atomic_cardinality = queue_atomic_policy<T,queue_notify_none,queue_backoff_spin_yield<>,Cardinality>;
+
+template <typename T, typename Alloc, template <typename> class Storage = queue_storage_atomic>
+using queue_atomic_alloc = queue_atomic_storage<T,queue_storage_alloc<Alloc,Storage>::template policy>;
+
+template <typename T, typename Cardinality, typename Layout>
+using queue_atomic_layout = queue_atomic<T,false,uint64_t,48,16,
+    std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+    queue_notify_none,queue_backoff_spin_yield<>,Cardinality,queue_storage_atomic,
+    queue_stats_none,queue_overflow_reject,Layout>;
+
+template <typename T, typename Overflow>
+using queue_atomic_overflow = queue_atomic<T,false,uint64_t,48,16,
+    std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+    queue_notify_none,queue_backoff_spin_yield<>,queue_mpmc,queue_storage_atomic,
+    queue_stats_none,Overflow>;
+
+
 /* test_push_pop_worker */
 
 template<typename item_type, typename queue_type>
@@ -68,11 +267,13 @@ struct test_push_pop_worker : std::thread
     {
         // transfer items from the queue to the vector
         for (size_t i = 0; i < items_per_thread; i++) {
-            item_type v = queue.pop_front();
-            if (v) {
+            item_type v = item_type();
+            queue_status status;
+            while ((status = queue.try_pop(v)) == queue_busy) std::this_thread::yield();
+            if (status == queue_ok) {
                 vec.push_back(v);
             } else {
-                log_debug("%p queue.pop_front() returned null item", std::this_thread::get_id());
+                log_debug("%p queue.try_pop() returned empty", std::this_thread::get_id());
             }
         }
         // transfer items from vector to the queue
@@ -107,6 +308,8 @@ void test_push_pop_threads(const char* queue_type_name, const size_t num_threads
     assert(queue.size() == num_items);
     
     // run test iterations
+    perf.start();
+    const perf_sample p1 = perf.sample();
     const auto t1 = std::chrono::high_resolution_clock::now();
     for (size_t iter = 0; iter < iterations; iter++)
     {
@@ -123,6 +326,7 @@ void test_push_pop_threads(const char* queue_type_name, const size_t num_threads
         assert(queue.size() == num_items);
     }
     const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
     uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
     
     // transfer items to a set
@@ -146,16 +350,18 @@ void test_push_pop_threads(const char* queue_type_name, const size_t num_threads
     }
     assert(check_count == num_items);
     
-    printf("%-20s %-9zu %-9zu %-9zu %-9llu %-9llu %-9.6lf\n",
+    printf("%-20s %-9zu %-9zu %-9zu %-9llu %-9llu %-9.6lf",
             queue_type_name, num_threads, iterations, items_per_thread,
             (u64)work_time_us, (u64)num_ops, (double)work_time_us / (double)num_ops);
+    perf.print(p2 - p1, num_ops);
 }
 
 static void heading_multi()
 {
-    printf("%-20s %-9s %-9s %-9s %-9s %-9s %-9s\n",
+    printf("%-20s %-9s %-9s %-9s %-9s %-9s %-9s",
             "name", "nthreads", "iters", "items",
             "time(us)", "op_count", "op(us)");
+    perf.heading();
 }
 
 template<typename item_type, typename queue_type>
@@ -166,11 +372,14 @@ void test_push_pop_single(const char* queue_type_name, const size_t num_items)
     assert(queue.size() == 0);
 
     // populate queue
+    perf.start();
+    const perf_sample p1 = perf.sample();
     const auto t1 = std::chrono::high_resolution_clock::now();
     for (size_t i = 1; i <= num_items; i++) {
         queue.push_back(item_type(i));
     }
     const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
     
     assert(queue.size() == num_items);
     
@@ -179,234 +388,2342 @@ void test_push_pop_single(const char* queue_type_name, const size_t num_items)
         queue.pop_front();
     }
     const auto t3 = std::chrono::high_resolution_clock::now();
+    const perf_sample p3 = perf.sample();
     
     assert(queue.size() == 0);
 
     uint64_t push_work_time_us = duration_cast<microseconds>(t2 - t1).count();
     uint64_t pop_work_time_us = duration_cast<microseconds>(t3 - t2).count();
 
-    printf("%-20s %-9zu %-9llu %-9llu %-9.6lf\n",
+    printf("%-20s %-9zu %-9llu %-9llu %-9.6lf",
            queue_type_name, num_items, (u64)push_work_time_us, (u64)num_items,
            (double)push_work_time_us / (double)num_items);
-    printf("%-20s %-9zu %-9llu %-9llu %-9.6lf\n",
+    perf.print(p2 - p1, num_items);
+    printf("%-20s %-9zu %-9llu %-9llu %-9.6lf",
            queue_type_name, num_items, (u64)pop_work_time_us, (u64)num_items,
            (double)pop_work_time_us / (double)num_items);
+    perf.print(p3 - p2, num_items);
 }
 
-static void heading_single()
+/* test_overwrite */
+
+template<typename item_type, typename queue_type>
+void test_overwrite_push(const char* queue_type_name, const size_t size_limit, const size_t num_items)
 {
-    printf("%-20s %-9s %-9s %-9s %-9s\n",
-            "name", "items", "time(us)", "op_count", "op(us)");
+    queue_type queue(size_limit);
+    
+    // keep the newest size_limit items; the overwrite queue drops the oldest
+    // itself, otherwise the producer pops one to make room when full
+    perf.start();
+    const perf_sample p1 = perf.sample();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 1; i <= num_items; i++) {
+        while (!queue.push_back(item_type(i))) {
+            queue.pop_front();
+        }
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
+    
+    assert(queue.size() == size_limit);
+    assert(queue.pop_front() == item_type(num_items - size_limit + 1));
+    
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    printf("%-20s %-9zu %-9llu %-9llu %-9.6lf",
+           queue_type_name, num_items, (u64)work_time_us, (u64)num_items,
+           (double)work_time_us / (double)num_items);
+    perf.print(p2 - p1, num_items);
 }
 
-/* test_queue */
+/* test_ipc */
 
-struct test_queue
+#if defined(__linux__)
+
+template<typename item_type>
+void test_ipc_shm(const char* name, const size_t num_items)
 {
-    void test_queue_constants()
-    {
-        const size_t qsize = 1024;
-        typedef queue_atomic<void*> qtype;
-        qtype q(qsize);
-        
-        printf("queue_atomic::is_lock_free  = %u\n", q.counter_back.is_lock_free());
-        printf("queue_atomic::atomic_bits   = %u\n", qtype::atomic_bits);
-        printf("queue_atomic::offset_bits   = %u\n", qtype::offset_bits);
-        printf("queue_atomic::version_bits  = %u\n", qtype::version_bits);
-        printf("queue_atomic::offset_shift  = %u\n", qtype::offset_shift);
-        printf("queue_atomic::version_shift = %u\n", qtype::version_shift);
-        printf("queue_atomic::size_max      = 0x%016llx (%llu)\n", (u64)qtype::size_max, (u64)qtype::size_max);
-        printf("queue_atomic::offset_limit  = 0x%016llx (%llu)\n", (u64)qtype::offset_limit, (u64)qtype::offset_limit);
-        printf("queue_atomic::version_limit = 0x%016llx (%llu)\n", (u64)qtype::version_limit, (u64)qtype::version_limit);
-        printf("queue_atomic::offset_mask   = 0x%016llx\n", (u64)qtype::offset_mask);
-        printf("queue_atomic::version_mask  = 0x%016llx\n", (u64)qtype::version_mask);
-        
-        assert(qtype::atomic_bits   == 64);
-        assert(qtype::offset_bits   == 48);
-        assert(qtype::version_bits  == 16);
-        assert(qtype::offset_shift  == 0);
-        assert(qtype::version_shift == 48);
-        assert(qtype::size_max      == 140737488355328ULL);
-        assert(qtype::offset_limit  == 281474976710656ULL);
-        assert(qtype::version_limit == 65536);
-        assert(qtype::offset_mask   == 0x0000ffffffffffffULL);
-        assert(qtype::version_mask  == 0x000000000000ffffULL);
-    }
+    typedef queue_shm<item_type,queue_spsc> shm_type;
+    const u64 expected = (u64)num_items * (num_items + 1) / 2;
+    shm_type shm;
+    int fd = memfd_create("test_queue_shm", 0);
+    assert(fd >= 0);
+    bool created = shm.create(fd, 65536);
+    assert(created);
     
-    void test_empty_invariants()
-    {
-        const size_t qsize = 1024;
-        typedef queue_atomic<void*> qtype;
-        qtype q(qsize);
-        
-        assert(q.capacity() == 1024);
-        assert(q.size() == 0);
-        assert(q.empty() == true);
-        assert(q.full() == false);
-        assert(q.size_limit == 1024);
-        assert(q._back_version() == 0);
-        assert(q._front_version() == 0);
-        assert(q._back() == 0);
-        assert(q._front() == 1024);
+    // the child maps the block again at its own address and consumes
+    perf.start();
+    const perf_sample p1 = perf.sample();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        shm_type child;
+        bool ok = child.attach(dup(fd));
+        u64 sum = 0;
+        item_type v = item_type();
+        for (size_t read = 0; ok && read < num_items; ) {
+            if (child->try_pop(v) == queue_ok) {
+                sum += (u64)v;
+                read++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        _exit(ok && sum == expected ? 0 : 1);
+    }
+    for (size_t i = 1; i <= num_items; i++) {
+        while (!shm->push_back(item_type(i))) std::this_thread::yield();
     }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
     
-    void test_push_pop()
-    {
-        const size_t qsize = 4;
-        typedef queue_atomic<void*> qtype;
-        qtype q(qsize);
-        
-        // check initial invariants
-        assert(q.capacity() == qsize);
-        assert(q.size() == 0);
-        assert(q.empty() == true);
-        assert(q.full() == false);
-        assert(q.size_limit == qsize);
-        assert(q._back_version() == 0);
-        assert(q._front_version() == 0);
-        assert(q._back() == 0);
-        assert(q._front() == qsize);
-        
-        // push_back 4 items
-        for (size_t i = 1; i <= 4; i++) {
-            assert(q.push_back((void*)i) == true);
-            assert(q._back_version() == i);
-            assert(q._front_version() == 0);
-            assert(q._back() == i);
-            assert(q._front() == qsize);
-            assert(q.size() == i);
-            assert(q.empty() == false);
-            assert(q.full() == (i < 4 ? false : true));
-        }
-        
-        // push_back overflow test
-        assert(q.push_back((void*)5) == false);
-        assert(q._back_version() == 4);
-        assert(q._front_version() == 0);
-        assert(q._back() == 4);
-        assert(q._front() == qsize);
-        assert(q.size() == 4);
-        assert(q.empty() == false);
-        assert(q.full() == true);
-        
-        // pop_front 4 items
-        for (size_t i = 1; i <= 4; i++) {
-            assert(q.pop_front() == (void*)i);
-            assert(q._back_version() == 4);
-            assert(q._front_version() == i);
-            assert(q._back() == 4);
-            assert(q._front() == 4 + i);
-            assert(q.size() == 4 - i);
-            assert(q.empty() == (i > 3 ? true : false));
-            assert(q.full() == false);
-        }
-        
-        // pop_front underflow test
-        assert(q.pop_front() == (void*)0);
-        assert(q._back_version() == 4);
-        assert(q._front_version() == 4);
-        assert(q._back() == 4);
-        assert(q._front() == 8);
-        assert(q.size() == 0);
-        assert(q.empty() == true);
-        assert(q.full() == false);
-        
-        // push_back 4 items
-        for (size_t i = 1; i <= 4; i++) {
-            assert(q.push_back((void*)i) == true);
-            assert(q._back_version() == 4 + i);
-            assert(q._front_version() == 4);
-            assert(q._back() == 4 + i);
-            assert(q._front() == 8);
-            assert(q.size() == i);
-            assert(q.empty() == false);
-            assert(q.full() == (i < 4 ? false : true));
-        }
-        
-        // push_back overflow test
-        assert(q.push_back((void*)5) == false);
-        assert(q._back_version() == 8);
-        assert(q._front_version() == 4);
-        assert(q._back() == 8);
-        assert(q._front() == 8);
-        assert(q.size() == 4);
-        assert(q.empty() == false);
-        assert(q.full() == true);
-        
-        // pop_front 4 items
-        for (size_t i = 1; i <= 4; i++) {
-            assert(q.pop_front() == (void*)i);
-            assert(q._back_version() == 8);
-            assert(q._front_version() == 4 + i);
-            assert(q._back() == 8);
-            assert(q._front() == 8 + i);
-            assert(q.size() == 4 - i);
-            assert(q.empty() == (i > 3 ? true : false));
-            assert(q.full() == false);
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    printf("%-20s %-9zu %-9llu %-9llu %-9.6lf",
+           name, num_items, (u64)work_time_us, (u64)num_items,
+           (double)work_time_us / (double)num_items);
+    perf.print(p2 - p1, num_items);
+}
+
+template<typename item_type>
+void test_ipc_stream(const char* name, const size_t num_items, const size_t batch, const bool unix_socket)
+{
+    const u64 expected = (u64)num_items * (num_items + 1) / 2;
+    int fds[2];
+    int ret = unix_socket ? socketpair(AF_UNIX, SOCK_STREAM, 0, fds) : pipe(fds);
+    assert(ret == 0);
+    
+    // the same transfer through the kernel, batch items per write
+    perf.start();
+    const perf_sample p1 = perf.sample();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[1]);
+        std::vector<item_type> buf(batch);
+        u64 sum = 0;
+        size_t bytes = 0, total = num_items * sizeof(item_type);
+        while (bytes < total) {
+            size_t offset = bytes % (batch * sizeof(item_type));
+            ssize_t n = read(fds[0], (char*)buf.data() + offset, batch * sizeof(item_type) - offset);
+            if (n <= 0) break;
+            for (size_t i = offset / sizeof(item_type); i < (offset + n) / sizeof(item_type); i++) {
+                sum += (u64)buf[i];
+            }
+            bytes += n;
         }
-        
-        // pop_front underflow test
-        assert(q.pop_front() == (void*)0);
-        assert(q._back_version() == 8);
-        assert(q._front_version() == 8);
-        assert(q._back() == 8);
-        assert(q._front() == 12);
-        assert(q.size() == 0);
-        assert(q.empty() == true);
-        assert(q.full() == false);
+        _exit(sum == expected ? 0 : 1);
     }
-    
-    void test_push_pop_single_queue_mutex()
-    {
-        test_push_pop_single<int,queue_std_mutex<int>>("queue_std_mutex", 8388608);
+    close(fds[0]);
+    std::vector<item_type> buf(batch);
+    for (size_t i = 1; i <= num_items; ) {
+        size_t count = 0;
+        for (; count < batch && i <= num_items; count++, i++) buf[count] = item_type(i);
+        for (size_t sent = 0; sent < count * sizeof(item_type); ) {
+            ssize_t n = write(fds[1], (char*)buf.data() + sent, count * sizeof(item_type) - sent);
+            assert(n > 0);
+            sent += n;
+        }
     }
+    close(fds[1]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
     
-    void test_push_pop_single_queue_atomic()
-    {
-        test_push_pop_single<int,queue_atomic<int>>("queue_atomic", 8388608);
-    }
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    printf("%-20s %-9zu %-9llu %-9llu %-9.6lf",
+           name, num_items, (u64)work_time_us, (u64)num_items,
+           (double)work_time_us / (double)num_items);
+    perf.print(p2 - p1, num_items);
+}
 
-    void test_push_pop_threads_queue_mutex()
-    {
-        test_push_pop_threads<int,queue_std_mutex<int>>("queue_std_mutex", 8, 10, 1024);
-    }
+/* test_notify_epoll */
 
-    void test_push_pop_threads_queue_atomic()
-    {
-        test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 10, 1024);
-        test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 10, 1024);
-        test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 10, 65536);
-        test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 10, 65536);
+static u64 steady_ns()
+{
+    return (u64)duration_cast<nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename queue_type>
+void test_notify_epoll(const char* name, const size_t num_bursts, const size_t burst)
+{
+    const size_t num_items = num_bursts * burst;
+    queue_type queue(65536);
+    u64 wakeups = 0, latency_ns = 0, push_ns = 0;
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    assert(ep >= 0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    int ret = epoll_ctl(ep, EPOLL_CTL_ADD, queue.notify_back.fd(), &ev);
+    assert(ret == 0);
+
+    // consumer: epoll loop that arms the notifier then drains the queue
+    std::thread consumer([&] {
+        size_t received = 0;
+        while (received < num_items) {
+            struct epoll_event out;
+            if (epoll_wait(ep, &out, 1, -1) != 1) continue;
+            wakeups++;
+            queue.notify_back.arm();
+            u64 v = 0;
+            while (queue.try_pop(v) == queue_ok) {
+                latency_ns += steady_ns() - v;
+                received++;
+            }
+        }
+    });
+
+    // producer: bursts of timestamped items with an idle gap between bursts
+    for (size_t i = 0; i < num_bursts; i++) {
+        u64 t1 = steady_ns();
+        for (size_t j = 0; j < burst; j++) {
+            while (!queue.push_back(steady_ns())) std::this_thread::yield();
+        }
+        push_ns += steady_ns() - t1;
+        std::this_thread::sleep_for(microseconds(100));
+    }
+    consumer.join();
+    close(ep);
+
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf %-9.3lf\n",
+           name, burst, num_items, (u64)queue.notify_back.signals, wakeups,
+           (double)push_ns / 1000.0 / (double)num_items,
+           (double)latency_ns / 1000.0 / (double)num_items);
+}
+
+static void heading_notify()
+{
+    printf("%-20s %-9s %-9s %-9s %-9s %-9s %-9s\n",
+            "name", "burst", "items", "signals", "wakeups", "push(us)", "lat(us)");
+}
+
+#endif
+
+/* test_transfer_threads */
+
+template<typename item_type, typename queue_type>
+void test_transfer_threads(const char* queue_type_name, const size_t num_producers, const size_t num_consumers,
+                           const size_t items_per_producer, const size_t queue_size)
+{
+    const size_t num_items = num_producers * items_per_producer;
+
+    queue_type queue(queue_size);
+    std::atomic<size_t> consumed(0);
+    std::atomic<u64> consumed_sum(0);
+    std::vector<std::thread> threads;
+
+    // producers push distinct items, consumers pop until all items are consumed
+    perf.start();
+    const perf_sample p1 = perf.sample();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t p = 0; p < num_producers; p++) {
+        threads.push_back(std::thread([&queue, p, items_per_producer] {
+            for (size_t i = 1; i <= items_per_producer; i++) {
+                item_type v = item_type(p * items_per_producer + i);
+                while (!queue.push_back(v)) std::this_thread::yield();
+            }
+        }));
+    }
+    for (size_t c = 0; c < num_consumers; c++) {
+        threads.push_back(std::thread([&queue, &consumed, &consumed_sum, num_items] {
+            u64 sum = 0;
+            while (consumed.load(std::memory_order_relaxed) < num_items) {
+                item_type v = queue.pop_front();
+                if (v) {
+                    sum += (u64)v;
+                    consumed.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            consumed_sum.fetch_add(sum);
+        }));
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+
+    assert(queue.size() == 0);
+    assert(consumed == num_items);
+    assert(consumed_sum == (u64)num_items * (num_items + 1) / 2);
+
+    printf("%-20s %-9zu %-9zu %-9zu %-9llu %-9llu %-9.6lf",
+            queue_type_name, num_producers, num_consumers, items_per_producer,
+            (u64)work_time_us, (u64)num_items, (double)work_time_us / (double)num_items);
+    perf.print(p2 - p1, num_items);
+}
+
+static void heading_transfer()
+{
+    printf("%-20s %-9s %-9s %-9s %-9s %-9s %-9s",
+            "name", "producer", "consumer", "items",
+            "time(us)", "op_count", "op(us)");
+    perf.heading();
+}
+
+static void heading_single()
+{
+    printf("%-20s %-9s %-9s %-9s %-9s",
+            "name", "items", "time(us)", "op_count", "op(us)");
+    perf.heading();
+}
+
+template<typename item_type, typename queue_type>
+void test_push_pop_batch(const char* queue_type_name, const size_t num_items, const size_t batch)
+{
+    queue_type queue(num_items);
+    std::vector<item_type> buf(batch);
+
+    assert(queue.size() == 0);
+
+    // populate queue
+    perf.start();
+    const perf_sample p1 = perf.sample();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 1; i <= num_items; i += batch) {
+        for (size_t j = 0; j < batch; j++) {
+            buf[j] = item_type(i + j);
+        }
+        size_t count = queue.push_back_n(buf.begin(), batch);
+        assert(count == batch);
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
+
+    assert(queue.size() == num_items);
+
+    // empty queue
+    for (size_t i = 1; i <= num_items; i += batch) {
+        size_t count = queue.pop_front_n(buf.begin(), batch);
+        assert(count == batch);
+        assert(buf[0] == item_type(i));
+    }
+    const auto t3 = std::chrono::high_resolution_clock::now();
+    const perf_sample p3 = perf.sample();
+
+    assert(queue.size() == 0);
+
+    uint64_t push_work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    uint64_t pop_work_time_us = duration_cast<microseconds>(t3 - t2).count();
+
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf",
+           queue_type_name, batch, num_items, (u64)push_work_time_us, (u64)num_items,
+           (double)push_work_time_us / (double)num_items);
+    perf.print(p2 - p1, num_items);
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf",
+           queue_type_name, batch, num_items, (u64)pop_work_time_us, (u64)num_items,
+           (double)pop_work_time_us / (double)num_items);
+    perf.print(p3 - p2, num_items);
+}
+
+template<typename item_type, typename queue_type>
+void test_pop_wait_idle(const char* queue_type_name, const size_t idle_ms)
+{
+    queue_type queue(1024);
+    uint64_t cpu_time_us = 0;
+
+    // consumer parks on the empty queue until the producer wakes it
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    std::thread consumer([&] {
+        struct timespec c1, c2;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c1);
+        item_type v = queue.pop_front_wait();
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c2);
+        assert(v == item_type(1));
+        cpu_time_us = (c2.tv_sec - c1.tv_sec) * 1000000 + (c2.tv_nsec - c1.tv_nsec) / 1000;
+    });
+    std::this_thread::sleep_for(milliseconds(idle_ms));
+    queue.push_back(item_type(1));
+    consumer.join();
+    const auto t2 = std::chrono::high_resolution_clock::now();
+
+    uint64_t wall_time_us = duration_cast<microseconds>(t2 - t1).count();
+
+    printf("%-20s %-9llu %-9llu %-9.6lf\n",
+           queue_type_name, (u64)wall_time_us, (u64)cpu_time_us,
+           (double)cpu_time_us / (double)wall_time_us);
+}
+
+static void heading_wait()
+{
+    printf("%-20s %-9s %-9s %-9s\n",
+            "name", "wall(us)", "cpu(us)", "cpu/wall");
+}
+
+template<typename frame_type, typename queue_type>
+void test_frame_copy(const char* queue_type_name, const size_t num_items, const size_t qsize)
+{
+    queue_type queue(qsize);
+    u64 sum = 0;
+
+    // build each frame on the stack then copy it into the queue
+    perf.start();
+    const perf_sample p1 = perf.sample();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_items; i += qsize) {
+        for (size_t j = 0; j < qsize; j++) {
+            frame_type frame;
+            frame.seq = i + j;
+            memset(frame.payload, (int)j, sizeof(frame.payload));
+            queue.push_back(frame);
+        }
+        for (size_t j = 0; j < qsize; j++) {
+            typename queue_type::slot_span span = queue.peek_front();
+            sum += span[0].seq + span[0].payload[0];
+            queue.release(span);
+        }
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    assert(sum > 0);
+
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf",
+           queue_type_name, sizeof(frame_type), num_items, (u64)work_time_us, (u64)num_items,
+           (double)work_time_us / (double)num_items);
+    perf.print(p2 - p1, num_items);
+}
+
+template<typename frame_type, typename queue_type>
+void test_frame_inplace(const char* queue_type_name, const size_t num_items, const size_t qsize)
+{
+    queue_type queue(qsize);
+    u64 sum = 0;
+
+    // build each frame in place in the reserved slot
+    perf.start();
+    const perf_sample p1 = perf.sample();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_items; i += qsize) {
+        for (size_t j = 0; j < qsize; j++) {
+            typename queue_type::slot_span span = queue.reserve_back();
+            span[0].seq = i + j;
+            memset(span[0].payload, (int)j, sizeof(span[0].payload));
+            queue.commit(span);
+        }
+        for (size_t j = 0; j < qsize; j++) {
+            typename queue_type::slot_span span = queue.peek_front();
+            sum += span[0].seq + span[0].payload[0];
+            queue.release(span);
+        }
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    assert(sum > 0);
+
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf",
+           queue_type_name, sizeof(frame_type), num_items, (u64)work_time_us, (u64)num_items,
+           (double)work_time_us / (double)num_items);
+    perf.print(p2 - p1, num_items);
+}
+
+template<typename frame_type, typename queue_type>
+void test_payload_single(const char* queue_type_name, const size_t num_items)
+{
+    queue_type queue(num_items);
+    frame_type frame;
+    memset(&frame, 0, sizeof(frame));
+
+    // populate queue
+    perf.start();
+    const perf_sample p1 = perf.sample();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 1; i <= num_items; i++) {
+        frame.seq = i;
+        queue.push_back(frame);
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
+
+    assert(queue.size() == num_items);
+
+    // empty queue
+    for (size_t i = 1; i <= num_items; i++) {
+        size_t count = queue.pop_front_n(&frame, 1);
+        assert(count == 1);
+        assert(frame.seq == i);
+    }
+    const auto t3 = std::chrono::high_resolution_clock::now();
+    const perf_sample p3 = perf.sample();
+
+    assert(queue.size() == 0);
+
+    uint64_t push_work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    uint64_t pop_work_time_us = duration_cast<microseconds>(t3 - t2).count();
+
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf",
+           queue_type_name, sizeof(frame_type), num_items, (u64)push_work_time_us, (u64)num_items,
+           (double)push_work_time_us / (double)num_items);
+    perf.print(p2 - p1, num_items);
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf",
+           queue_type_name, sizeof(frame_type), num_items, (u64)pop_work_time_us, (u64)num_items,
+           (double)pop_work_time_us / (double)num_items);
+    perf.print(p3 - p2, num_items);
+}
+
+static void heading_frame()
+{
+    printf("%-20s %-9s %-9s %-9s %-9s %-9s",
+            "name", "bytes", "items", "time(us)", "op_count", "op(us)");
+    perf.heading();
+}
+
+template<typename item_type, typename queue_type>
+void test_drain(const char* queue_type_name, const size_t num_items, const size_t burst, const bool consume)
+{
+    queue_type queue(burst);
+    std::vector<item_type> buf(burst);
+    u64 sum = 0;
+
+    // push a burst then drain it with a pop_front loop or one consume_all
+    perf.start();
+    const perf_sample p1 = perf.sample();
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_items; i += burst) {
+        for (size_t j = 0; j < burst; j++) {
+            buf[j] = item_type(i + j + 1);
+        }
+        queue.push_back_n(buf.begin(), burst);
+        if (consume) {
+            queue.consume_all([&](typename queue_type::item_t *first, size_t count) {
+                for (size_t j = 0; j < count; j++) sum += first[j];
+            });
+        } else {
+            item_type v = item_type();
+            while ((v = queue.pop_front())) sum += v;
+        }
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    const perf_sample p2 = perf.sample();
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    assert(sum == (u64)num_items * (num_items + 1) / 2);
+
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf",
+           queue_type_name, burst, num_items, (u64)work_time_us, (u64)num_items,
+           (double)work_time_us / (double)num_items);
+    perf.print(p2 - p1, num_items);
+}
+
+static void heading_batch()
+{
+    printf("%-20s %-9s %-9s %-9s %-9s %-9s",
+            "name", "batch", "items", "time(us)", "op_count", "op(us)");
+    perf.heading();
+}
+
+/* test_contention_stats */
+
+static u64 hist_percentile(const uint64_t *hist, int buckets, u64 total, double pct)
+{
+    u64 target = (u64)(total * pct), sum = 0;
+    for (int b = 0; b < buckets; b++) {
+        sum += hist[b];
+        if (sum > target) return b == 0 ? 0 : (u64)1 << (b - 1);
+    }
+    return (u64)1 << (buckets - 1);
+}
+
+template<typename item_type, typename queue_type>
+void test_contention_stats(const char* queue_type_name, const size_t num_threads, const size_t iterations, const size_t items_per_thread)
+{
+    const size_t num_items = num_threads * items_per_thread;
+    queue_type queue(num_items);
+    
+    for (size_t i = 1; i <= num_items; i++) {
+        queue.push_back(item_type(i));
+    }
+    
+    // each thread pops then pushes back its share of the items
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&queue, iterations, items_per_thread] {
+            std::vector<item_type> vec;
+            for (size_t iter = 0; iter < iterations; iter++) {
+                for (size_t i = 0; i < items_per_thread; i++) {
+                    item_type v = item_type();
+                    if (queue.try_pop(v) == queue_ok) vec.push_back(v);
+                }
+                for (auto v : vec) {
+                    while (!queue.push_back(v)) std::this_thread::yield();
+                }
+                vec.clear();
+            }
+        }));
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    assert(queue.size() == num_items);
+    
+    queue_stats_snapshot s = queue.stats.snapshot();
+    const int buckets = queue_stats_snapshot::hist_buckets;
+    printf("%-20s %-9zu %-9llu %-9llu %-9llu %-9llu %-9llu %-9llu %-9llu %-9llu\n",
+           queue_type_name, num_threads, (u64)s.attempts,
+           (u64)s.phase1_failures, (u64)s.phase2_failures, (u64)s.spin_limit_exhausted,
+           (u64)(s.attempts ? s.cycles / s.attempts : 0),
+           hist_percentile(s.cycle_hist, buckets, s.attempts, 0.5),
+           hist_percentile(s.cycle_hist, buckets, s.attempts, 0.99),
+           hist_percentile(s.retry_hist, buckets, s.attempts, 0.99));
+}
+
+static void heading_stats()
+{
+    printf("%-20s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s %-9s\n",
+           "name", "nthreads", "attempts", "phase1", "phase2", "exhaust",
+           "cyc/op", "cyc_p50", "cyc_p99", "retry_p99");
+}
+
+/* test_executor_tasks */
+
+struct test_count_task : queue_task
+{
+    std::atomic<size_t> &count;
+    
+    test_count_task(std::atomic<size_t> &count) : count(count) {}
+    
+    void run() { count.fetch_add(1, std::memory_order_relaxed); }
+};
+
+static void test_executor_tasks(const char* name, const size_t num_workers, const size_t num_tasks, const size_t batch)
+{
+    std::atomic<size_t> count(0);
+    std::vector<test_count_task> tasks(num_tasks, test_count_task(count));
+    std::vector<queue_task*> ptrs;
+    for (auto &task : tasks) {
+        ptrs.push_back(&task);
+    }
+    
+    // workers are started before timing so only submission and execution are measured
+    queue_executor<> executor(num_workers);
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    if (batch > 1) {
+        for (size_t i = 0; i < num_tasks; i += batch) {
+            executor.submit_n(ptrs.data() + i, std::min(batch, num_tasks - i));
+        }
+    } else {
+        for (size_t i = 0; i < num_tasks; i++) {
+            executor.submit(ptrs[i]);
+        }
+    }
+    executor.drain();
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    assert(count == num_tasks);
+    
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    printf("%-20s %-9zu %-9zu %-9zu %-9llu %-9.6lf\n",
+           name, num_workers, batch, num_tasks, (u64)work_time_us,
+           (double)work_time_us / (double)num_tasks);
+}
+
+static void test_async_tasks(const char* name, const size_t num_tasks)
+{
+    std::atomic<size_t> count(0);
+    std::vector<std::future<void>> futures;
+    
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_tasks; i++) {
+        futures.push_back(std::async(std::launch::async, [&count] {
+            count.fetch_add(1, std::memory_order_relaxed);
+        }));
+    }
+    for (auto &future : futures) {
+        future.wait();
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    assert(count == num_tasks);
+    
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    printf("%-20s %-9s %-9zu %-9zu %-9llu %-9.6lf\n",
+           name, "-", (size_t)1, num_tasks, (u64)work_time_us,
+           (double)work_time_us / (double)num_tasks);
+}
+
+static void heading_executor()
+{
+    printf("%-20s %-9s %-9s %-9s %-9s %-9s\n",
+            "name", "workers", "batch", "tasks", "time(us)", "task(us)");
+}
+
+/* test_fanout */
+
+template<typename item_type>
+void test_fanout_broadcast(const char* name, const size_t num_consumers, const size_t num_items, const size_t batch)
+{
+    queue_broadcast<item_type> queue(4096, num_consumers);
+    std::vector<int> ids;
+    for (size_t c = 0; c < num_consumers; c++) {
+        ids.push_back(queue.subscribe());
+    }
+    std::vector<u64> sums(num_consumers);
+    std::vector<std::thread> threads;
+    
+    // every consumer reads every item in batches up to the published cursor
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t c = 0; c < num_consumers; c++) {
+        threads.push_back(std::thread([&queue, &ids, &sums, c, num_items, batch] {
+            std::vector<item_type> buf(batch);
+            u64 sum = 0;
+            for (size_t read = 0; read < num_items; ) {
+                size_t count = queue.pop_front_n(ids[c], buf.begin(), batch);
+                if (count == 0) std::this_thread::yield();
+                for (size_t i = 0; i < count; i++) sum += (u64)buf[i];
+                read += count;
+            }
+            sums[c] = sum;
+        }));
+    }
+    for (size_t i = 1; i <= num_items; i++) {
+        while (!queue.push_back(item_type(i))) std::this_thread::yield();
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    for (size_t c = 0; c < num_consumers; c++) {
+        assert(sums[c] == (u64)num_items * (num_items + 1) / 2);
+    }
+    
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf\n",
+           name, num_consumers, num_items, (u64)work_time_us, (u64)num_items,
+           (double)work_time_us / (double)num_items);
+}
+
+template<typename item_type>
+void test_fanout_copies(const char* name, const size_t num_consumers, const size_t num_items)
+{
+    typedef queue_atomic_cardinality<item_type,queue_spsc> queue_type;
+    typedef std::unique_ptr<queue_type,void(*)(queue_type*)> queue_ptr;
+    std::vector<queue_ptr> queues;
+    for (size_t c = 0; c < num_consumers; c++) {
+        queues.push_back(queue_ptr(queue_aligned_new<queue_type>(4096), queue_aligned_delete<queue_type>));
+    }
+    std::vector<u64> sums(num_consumers);
+    std::vector<std::thread> threads;
+    
+    // one queue per consumer, the producer copies each item into every queue
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t c = 0; c < num_consumers; c++) {
+        threads.push_back(std::thread([&queues, &sums, c, num_items] {
+            u64 sum = 0;
+            item_type v = item_type();
+            for (size_t read = 0; read < num_items; ) {
+                if (queues[c]->try_pop(v) == queue_ok) {
+                    sum += (u64)v;
+                    read++;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            sums[c] = sum;
+        }));
+    }
+    for (size_t i = 1; i <= num_items; i++) {
+        for (size_t c = 0; c < num_consumers; c++) {
+            while (!queues[c]->push_back(item_type(i))) std::this_thread::yield();
+        }
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    for (size_t c = 0; c < num_consumers; c++) {
+        assert(sums[c] == (u64)num_items * (num_items + 1) / 2);
+    }
+    
+    uint64_t work_time_us = duration_cast<microseconds>(t2 - t1).count();
+    printf("%-20s %-9zu %-9zu %-9llu %-9llu %-9.6lf\n",
+           name, num_consumers, num_items, (u64)work_time_us, (u64)num_items,
+           (double)work_time_us / (double)num_items);
+}
+
+static void heading_fanout()
+{
+    printf("%-20s %-9s %-9s %-9s %-9s %-9s\n",
+            "name", "consumer", "items", "time(us)", "op_count", "op(us)");
+}
+
+/* test_queue */
+
+struct test_queue
+{
+    void test_queue_constants()
+    {
+        const size_t qsize = 1024;
+        typedef queue_atomic<void*> qtype;
+        qtype q(qsize);
+        
+        printf("queue_atomic::is_lock_free  = %u\n", q.counter_back.is_lock_free());
+        printf("queue_atomic::atomic_bits   = %u\n", qtype::atomic_bits);
+        printf("queue_atomic::offset_bits   = %u\n", qtype::offset_bits);
+        printf("queue_atomic::version_bits  = %u\n", qtype::version_bits);
+        printf("queue_atomic::offset_shift  = %u\n", qtype::offset_shift);
+        printf("queue_atomic::version_shift = %u\n", qtype::version_shift);
+        printf("queue_atomic::size_max      = 0x%016llx (%llu)\n", (u64)qtype::size_max, (u64)qtype::size_max);
+        printf("queue_atomic::offset_limit  = 0x%016llx (%llu)\n", (u64)qtype::offset_limit, (u64)qtype::offset_limit);
+        printf("queue_atomic::version_limit = 0x%016llx (%llu)\n", (u64)qtype::version_limit, (u64)qtype::version_limit);
+        printf("queue_atomic::offset_mask   = 0x%016llx\n", (u64)qtype::offset_mask);
+        printf("queue_atomic::version_mask  = 0x%016llx\n", (u64)qtype::version_mask);
+        
+        assert(qtype::atomic_bits   == 64);
+        assert(qtype::offset_bits   == 48);
+        assert(qtype::version_bits  == 16);
+        assert(qtype::offset_shift  == 0);
+        assert(qtype::version_shift == 48);
+        assert(qtype::size_max      == 140737488355328ULL);
+        assert(qtype::offset_limit  == 281474976710656ULL);
+        assert(qtype::version_limit == 65536);
+        assert(qtype::offset_mask   == 0x0000ffffffffffffULL);
+        assert(qtype::version_mask  == 0x000000000000ffffULL);
+    }
+    
+#if QUEUE_HAS_UINT128
+    void test_queue_constants_u128()
+    {
+        const size_t qsize = 1024;
+        typedef queue_atomic<void*,false,queue_uint128_t,64,32> qtype;
+        qtype q(qsize);
+        
+        printf("queue_atomic_u128::is_lock_free  = %u\n", q.version_back.is_lock_free());
+        printf("queue_atomic_u128::atomic_bits   = %u\n", qtype::atomic_bits);
+        printf("queue_atomic_u128::offset_bits   = %u\n", qtype::offset_bits);
+        printf("queue_atomic_u128::version_bits  = %u\n", qtype::version_bits);
+        printf("queue_atomic_u128::version_shift = %u\n", qtype::version_shift);
+        printf("queue_atomic_u128::counter_shift = %u\n", qtype::counter_shift);
+        printf("queue_atomic_u128::version_limit = 0x%016llx (%llu)\n", (u64)qtype::version_limit, (u64)qtype::version_limit);
+        
+        assert(sizeof(q.version_back) == 16);
+        assert(qtype::packed_counter == true);
+        assert(qtype::atomic_bits   == 128);
+        assert(qtype::offset_bits   == 64);
+        assert(qtype::version_bits  == 32);
+        assert(qtype::version_shift == 64);
+        assert(qtype::counter_shift == 96);
+        assert(qtype::size_max      == (queue_uint128_t)1 << 63);
+        assert(qtype::version_limit == 4294967296ULL);
+        assert(qtype::version_mask  == 0x00000000ffffffffULL);
+    }
+    
+    void test_push_pop_u128()
+    {
+        const size_t qsize = 4;
+        typedef queue_atomic<void*,false,queue_uint128_t,64,32> qtype;
+        qtype q(qsize);
+        
+        // counter packed in the version word tracks the version outside the critical section
+        for (size_t lap = 0; lap < 2; lap++) {
+            for (size_t i = 1; i <= 4; i++) {
+                assert(q.push_back((void*)i) == true);
+                assert(q._back_version() == lap * 4 + i);
+                assert((q.version_back >> qtype::counter_shift) == lap * 4 + i);
+                assert(q._back() == lap * 4 + i);
+                assert(q.size() == i);
+            }
+            assert(q.push_back((void*)5) == false);
+            assert(q.full() == true);
+            for (size_t i = 1; i <= 4; i++) {
+                assert(q.pop_front() == (void*)i);
+                assert(q._front_version() == lap * 4 + i);
+                assert((q.version_front >> qtype::counter_shift) == lap * 4 + i);
+                assert(q._front() == 4 + lap * 4 + i);
+            }
+            assert(q.pop_front() == (void*)0);
+            assert(q.empty() == true);
+        }
+        
+        // the separate counters are unused
+        assert(q.counter_back == 0);
+        assert(q.counter_front == 0);
+    }
+#endif
+    
+    void test_empty_invariants()
+    {
+        const size_t qsize = 1024;
+        typedef queue_atomic<void*> qtype;
+        qtype q(qsize);
+        
+        assert(q.capacity() == 1024);
+        assert(q.size() == 0);
+        assert(q.empty() == true);
+        assert(q.full() == false);
+        assert(q.size_limit == 1024);
+        assert(q._back_version() == 0);
+        assert(q._front_version() == 0);
+        assert(q._back() == 0);
+        assert(q._front() == 1024);
+    }
+    
+    void test_push_pop()
+    {
+        const size_t qsize = 4;
+        typedef queue_atomic<void*> qtype;
+        qtype q(qsize);
+        
+        // check initial invariants
+        assert(q.capacity() == qsize);
+        assert(q.size() == 0);
+        assert(q.empty() == true);
+        assert(q.full() == false);
+        assert(q.size_limit == qsize);
+        assert(q._back_version() == 0);
+        assert(q._front_version() == 0);
+        assert(q._back() == 0);
+        assert(q._front() == qsize);
+        
+        // push_back 4 items
+        for (size_t i = 1; i <= 4; i++) {
+            assert(q.push_back((void*)i) == true);
+            assert(q._back_version() == i);
+            assert(q._front_version() == 0);
+            assert(q._back() == i);
+            assert(q._front() == qsize);
+            assert(q.size() == i);
+            assert(q.empty() == false);
+            assert(q.full() == (i < 4 ? false : true));
+        }
+        
+        // push_back overflow test
+        assert(q.push_back((void*)5) == false);
+        assert(q._back_version() == 4);
+        assert(q._front_version() == 0);
+        assert(q._back() == 4);
+        assert(q._front() == qsize);
+        assert(q.size() == 4);
+        assert(q.empty() == false);
+        assert(q.full() == true);
+        
+        // pop_front 4 items
+        for (size_t i = 1; i <= 4; i++) {
+            assert(q.pop_front() == (void*)i);
+            assert(q._back_version() == 4);
+            assert(q._front_version() == i);
+            assert(q._back() == 4);
+            assert(q._front() == 4 + i);
+            assert(q.size() == 4 - i);
+            assert(q.empty() == (i > 3 ? true : false));
+            assert(q.full() == false);
+        }
+        
+        // pop_front underflow test
+        assert(q.pop_front() == (void*)0);
+        assert(q._back_version() == 4);
+        assert(q._front_version() == 4);
+        assert(q._back() == 4);
+        assert(q._front() == 8);
+        assert(q.size() == 0);
+        assert(q.empty() == true);
+        assert(q.full() == false);
+        
+        // push_back 4 items
+        for (size_t i = 1; i <= 4; i++) {
+            assert(q.push_back((void*)i) == true);
+            assert(q._back_version() == 4 + i);
+            assert(q._front_version() == 4);
+            assert(q._back() == 4 + i);
+            assert(q._front() == 8);
+            assert(q.size() == i);
+            assert(q.empty() == false);
+            assert(q.full() == (i < 4 ? false : true));
+        }
+        
+        // push_back overflow test
+        assert(q.push_back((void*)5) == false);
+        assert(q._back_version() == 8);
+        assert(q._front_version() == 4);
+        assert(q._back() == 8);
+        assert(q._front() == 8);
+        assert(q.size() == 4);
+        assert(q.empty() == false);
+        assert(q.full() == true);
+        
+        // pop_front 4 items
+        for (size_t i = 1; i <= 4; i++) {
+            assert(q.pop_front() == (void*)i);
+            assert(q._back_version() == 8);
+            assert(q._front_version() == 4 + i);
+            assert(q._back() == 8);
+            assert(q._front() == 8 + i);
+            assert(q.size() == 4 - i);
+            assert(q.empty() == (i > 3 ? true : false));
+            assert(q.full() == false);
+        }
+        
+        // pop_front underflow test
+        assert(q.pop_front() == (void*)0);
+        assert(q._back_version() == 8);
+        assert(q._front_version() == 8);
+        assert(q._back() == 8);
+        assert(q._front() == 12);
+        assert(q.size() == 0);
+        assert(q.empty() == true);
+        assert(q.full() == false);
+    }
+    
+    void test_push_pop_n()
+    {
+        const size_t qsize = 8;
+        typedef queue_atomic<void*> qtype;
+        qtype q(qsize);
+        void* in[16];
+        void* out[16];
+        
+        for (size_t i = 0; i < 16; i++) {
+            in[i] = (void*)(i + 1);
+        }
+        
+        // push_back_n clamps to free space
+        assert(q.push_back_n(in, 5) == 5);
+        assert(q._back_version() == 1);
+        assert(q._back() == 5);
+        assert(q.size() == 5);
+        assert(q.push_back_n(in + 5, 8) == 3);
+        assert(q._back_version() == 2);
+        assert(q.full() == true);
+        assert(q.push_back_n(in, 1) == 0);
+        
+        // pop_front_n clamps to used space
+        assert(q.pop_front_n(out, 6) == 6);
+        assert(q._front_version() == 1);
+        assert(q._front() == 14);
+        for (size_t i = 0; i < 6; i++) {
+            assert(out[i] == in[i]);
+        }
+        
+        // push_back_n wraps around the end of the ring in two runs
+        assert(q.push_back_n(in + 8, 6) == 6);
+        assert(q.size() == 8);
+        assert(q.pop_front_n(out, 16) == 8);
+        assert(out[0] == in[6]);
+        assert(out[1] == in[7]);
+        for (size_t i = 2; i < 8; i++) {
+            assert(out[i] == in[i + 6]);
+        }
+        
+        // pop_front_n underflow test
+        assert(q.pop_front_n(out, 1) == 0);
+        assert(q.empty() == true);
+        assert(q._front() - q._back() == qsize);
+        
+        // empty batches claim nothing and leave both sides usable
+        assert(q.push_back_n(in, 0) == 0);
+        assert(q.pop_front_n(out, 0) == 0);
+        assert(q.push_back(in[0]) == true);
+        assert(q.push_back_n(in, 0) == 0);
+        assert(q.pop_front_n(out, 0) == 0);
+        assert(q.pop_front() == in[0]);
+        assert(q.push_back(in[1]) == true);
+        assert(q.pop_front() == in[1]);
+        assert(q.empty() == true);
+    }
+    
+    void test_push_pop_wait()
+    {
+        const size_t qsize = 4;
+        typedef queue_atomic<void*,false,uint64_t,48,16,
+            std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+            queue_notify_futex> qtype;
+        qtype q(qsize);
+        
+        // pop_front_wait_for times out on an empty queue
+        auto t1 = std::chrono::steady_clock::now();
+        assert(q.pop_front_wait_for(milliseconds(10)) == (void*)0);
+        assert(std::chrono::steady_clock::now() - t1 >= milliseconds(10));
+        
+        // push_back_wait_for times out on a full queue
+        for (size_t i = 1; i <= 4; i++) {
+            assert(q.push_back_wait((void*)i) == true);
+        }
+        t1 = std::chrono::steady_clock::now();
+        assert(q.push_back_wait_for((void*)5, milliseconds(10)) == false);
+        assert(std::chrono::steady_clock::now() - t1 >= milliseconds(10));
+        
+        // parked producer is woken by pop_front
+        std::thread producer([&] {
+            assert(q.push_back_wait((void*)5) == true);
+        });
+        std::this_thread::sleep_for(milliseconds(10));
+        assert(q.pop_front() == (void*)1);
+        producer.join();
+        assert(q.full() == true);
+        
+        // parked consumer is woken by push_back
+        for (size_t i = 2; i <= 5; i++) {
+            assert(q.pop_front_wait_until(std::chrono::steady_clock::now() + milliseconds(10)) == (void*)i);
+        }
+        std::thread consumer([&] {
+            assert(q.pop_front_wait() == (void*)6);
+        });
+        std::this_thread::sleep_for(milliseconds(10));
+        assert(q.push_back((void*)6) == true);
+        consumer.join();
+        assert(q.empty() == true);
+        
+        // a single push wakes one parked consumer and a batch wakes one per item
+        std::atomic<size_t> woken(0);
+        std::vector<std::thread> consumers;
+        for (size_t i = 0; i < 4; i++) {
+            consumers.push_back(std::thread([&] {
+                assert(q.pop_front_wait() != (void*)0);
+                woken++;
+            }));
+        }
+        std::this_thread::sleep_for(milliseconds(10));
+        assert(q.push_back((void*)7) == true);
+        while (woken < 1) std::this_thread::yield();
+        void* batch[3] = { (void*)8, (void*)9, (void*)10 };
+        assert(q.push_back_n(batch, 3) == 3);
+        for (auto &thread : consumers) {
+            thread.join();
+        }
+        assert(woken == 4);
+        assert(q.empty() == true);
+    }
+    
+    void test_push_pop_spsc()
+    {
+        const size_t qsize = 4;
+        typedef queue_atomic_cardinality<void*,queue_spsc> qtype;
+        qtype q(qsize);
+        
+        // versions advance without touching the counters
+        for (size_t i = 1; i <= 4; i++) {
+            assert(q.push_back((void*)i) == true);
+            assert(q._back_version() == i);
+            assert(q._back() == i);
+            assert(q.size() == i);
+        }
+        assert(q.push_back((void*)5) == false);
+        assert(q.full() == true);
+        for (size_t i = 1; i <= 4; i++) {
+            assert(q.pop_front() == (void*)i);
+            assert(q._front_version() == i);
+            assert(q._front() == 4 + i);
+        }
+        assert(q.pop_front() == (void*)0);
+        assert(q.empty() == true);
+        static_assert(std::is_empty<qtype::back_counter_t>::value, "spsc has no counter_back");
+        static_assert(std::is_empty<qtype::front_counter_t>::value, "spsc has no counter_front");
+        
+        // cached offsets are reloaded after wrapping around
+        void* in[3] = { (void*)1, (void*)2, (void*)3 };
+        for (size_t j = 0; j < 3; j++) {
+            assert(q.push_back_n(in, 3) == 3);
+            assert(q.pop_front() == (void*)1);
+            assert(q.pop_front() == (void*)2);
+            assert(q.pop_front() == (void*)3);
+            assert(q.pop_front() == (void*)0);
+        }
+        assert(q.empty() == true);
+    }
+    
+    void test_push_pop_seq()
+    {
+        const size_t qsize = 4;
+        typedef queue_atomic_seq<void*> qtype;
+        qtype q(qsize);
+        
+        assert(q.capacity() == qsize);
+        assert(q.size() == 0);
+        assert(q.empty() == true);
+        
+        // push_back, pop_front and wrap around for two laps
+        for (size_t lap = 0; lap < 2; lap++) {
+            for (size_t i = 1; i <= 4; i++) {
+                assert(q.push_back((void*)i) == true);
+                assert(q.size() == i);
+            }
+            assert(q.push_back((void*)5) == false);
+            assert(q.full() == true);
+            for (size_t i = 1; i <= 4; i++) {
+                assert(q.pop_front() == (void*)i);
+                assert(q.size() == 4 - i);
+            }
+            assert(q.pop_front() == (void*)0);
+            assert(q.empty() == true);
+            assert(q.counter_back == 4 * (lap + 1));
+            assert(q.counter_front == 4 * (lap + 1));
+        }
+    }
+    
+    void test_storage_inline()
+    {
+        const size_t qsize = 8;
+        typedef test_frame<40> frame_type;
+        typedef queue_atomic_storage<frame_type,queue_storage_inline> qtype;
+        qtype q(qsize);
+        frame_type in[8], out[8];
+        
+        assert(((uintptr_t)q.vec & 63) == 0);
+        for (size_t i = 0; i < 8; i++) {
+            in[i].seq = i + 1;
+            memset(in[i].payload, (int)i, sizeof(in[i].payload));
+        }
+        
+        // push_back_n and pop_front_n copy whole runs across the wrap-around point
+        assert(q.push_back_n(in, 5) == 5);
+        assert(q.pop_front_n(out, 5) == 5);
+        assert(q.push_back_n(in, 8) == 8);
+        assert(q.pop_front_n(out, 8) == 8);
+        assert(memcmp(in, out, sizeof(in)) == 0);
+        assert(q.empty() == true);
+    }
+    
+    template <typename Layout>
+    void test_layout(const size_t qsize, const bool spread)
+    {
+        typedef queue_atomic_layout<int,queue_mpmc,Layout> qtype;
+        qtype q(qsize);
+        
+        // every offset has its own slot and, once the ring spans enough cache
+        // lines, adjacent offsets use different lines
+        std::set<size_t> slots;
+        for (size_t i = 0; i < qsize; i++) {
+            slots.insert(&q.slot(i) - &q.vec[0]);
+            if (i > 0 && spread) {
+                assert(((uintptr_t)&q.slot(i) >> 6) != ((uintptr_t)&q.slot(i - 1) >> 6));
+            }
+        }
+        assert(slots.size() == qsize);
+        
+        // items keep their order across the wrap-around point
+        int in[16], out[16], v = 0;
+        for (int i = 0; i < 16; i++) in[i] = i + 1;
+        for (int round = 0; round < 3; round++) {
+            assert(q.push_back_n(in, 11) == 11);
+            assert(q.pop_front_n(out, 5) == 5);
+            for (int i = 0; i < 5; i++) assert(out[i] == i + 1);
+            for (int i = 6; i <= 11; i++) {
+                assert(q.try_pop(v) == queue_ok && v == i);
+            }
+        }
+        assert(q.empty() == true);
+    }
+    
+    void test_layout()
+    {
+        test_layout<queue_layout_linear>(16, false);
+        test_layout<queue_layout_rotate<>>(16, false);
+        test_layout<queue_layout_rotate<>>(1024, true);
+        test_layout<queue_layout_padded<>>(16, true);
+    }
+    
+    void test_storage_alloc()
+    {
+        // mmap storage is page aligned and zeroed, bound to node 0 and prefaulted
+        typedef queue_atomic_alloc<int,queue_alloc_mmap<queue_pages_transparent,0>> qtype;
+        qtype q(1024);
+        assert(((uintptr_t)q.vec & 4095) == 0);
+        assert(q.vec[1023].load() == 0);
+        for (int i = 1; i <= 1024; i++) {
+            assert(q.push_back(i) == true);
+        }
+        for (int i = 1; i <= 1024; i++) {
+            assert(q.pop_front() == i);
+        }
+        
+        // non-trivial slots are constructed in place and destroyed with the queue
+        typedef std::shared_ptr<int> item_ptr;
+        typedef queue_atomic_alloc<item_ptr,queue_alloc_mmap<queue_pages_small,-1,false>,queue_storage_raw> ptype;
+        item_ptr a(new int(1)), b(new int(2));
+        {
+            ptype p(4);
+            assert(p.push_back(a) == true);
+            assert(p.push_back(b) == true);
+            item_ptr v;
+            assert(p.try_pop(v) == queue_ok && v == a);
+            assert(b.use_count() == 2);
+        }
+        assert(a.use_count() == 1);
+        assert(b.use_count() == 1);
+        
+        // a failed node binding fails the allocation and the queue constructor
+        typedef queue_alloc_mmap<queue_pages_small,63> bad_node;
+        assert(bad_node::allocate(4096) == nullptr);
+        bool threw = false;
+        try {
+            queue_atomic_alloc<int,bad_node> f(16);
+        } catch (const std::bad_alloc&) {
+            threw = true;
+        }
+        assert(threw == true);
+    }
+    
+#if defined(__linux__)
+    void test_shm()
+    {
+        typedef queue_shm<int> shm_type;
+        shm_type a, b;
+        int fd = memfd_create("test_queue_shm", 0);
+        assert(fd >= 0);
+        assert(a.create(fd, 8) == true);
+        assert(a.header()->capacity == 8);
+        assert(a.header()->element_size == sizeof(shm_type::item_t));
+        assert(std::is_polymorphic<shm_type::queue_t>::value == false);
+        assert(std::is_polymorphic<queue_atomic<int>>::value == true);
+        
+        // a second mapping of the same block at another address shares the queue
+        assert(b.attach(dup(fd)) == true);
+        assert(a.base != b.base);
+        for (int i = 1; i <= 8; i++) {
+            assert(a->push_back(i) == true);
+        }
+        assert(b->push_back(9) == false);
+        int v = 0;
+        for (int i = 1; i <= 8; i++) {
+            assert(b->try_pop(v) == queue_ok && v == i);
+        }
+        assert(a->empty() == true);
+        
+        // attach checks the header against the expected layout
+        // and closes the descriptor it was handed when it fails
+        queue_shm<test_frame<64>,queue_mpmc,queue_storage_inline> c;
+        int cfd = dup(fd);
+        assert(c.attach(cfd) == false);
+        assert(c.attached() == false);
+        assert(fcntl(cfd, F_GETFD) == -1 && errno == EBADF);
+        
+        // attaching an attached handle replaces its mapping
+        assert(b.attach(dup(fd)) == true);
+        assert(a->push_back(10) == true);
+        assert(b->pop_front() == 10);
+        
+        // named shared memory objects
+        char name[64];
+        snprintf(name, sizeof(name), "/test_queue_shm.%d", (int)getpid());
+        shm_type d, e, f;
+        assert(d.create(name, 16) == true);
+        assert(e.create(name, 16) == false);
+        assert(f.attach(name) == true);
+        assert(d->push_back(42) == true);
+        assert(f->pop_front() == 42);
+        shm_type::unlink(name);
+    }
+#endif
+    
+#if defined(__linux__)
+    void test_notify_eventfd()
+    {
+        typedef queue_atomic_policy<int,queue_notify_eventfd<>,queue_backoff_spin_yield<>> qtype;
+        typedef queue_atomic_policy<int,queue_notify_eventfd<false>,queue_backoff_spin_yield<>> qtype_naive;
+        qtype q(16);
+        int fd = q.notify_back.fd();
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        assert(fd >= 0);
+        assert(poll(&pfd, 1, 0) == 0);
+        
+        // a burst of pushes makes one write while the consumer is armed
+        for (int i = 1; i <= 10; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.notify_back.signals == 1);
+        assert(poll(&pfd, 1, 0) == 1);
+        
+        // arm clears the eventfd and asks for the next signal
+        q.notify_back.arm();
+        assert(poll(&pfd, 1, 0) == 0);
+        int v = 0;
+        while (q.try_pop(v) == queue_ok) {}
+        assert(q.notify_back.signals == 1);
+        assert(q.push_back(11) == true);
+        assert(q.push_back(12) == true);
+        assert(q.notify_back.signals == 2);
+        assert(poll(&pfd, 1, 0) == 1);
+        
+        // parked consumer is woken through the eventfd
+        q.notify_back.arm();
+        while (q.try_pop(v) == queue_ok) {}
+        std::thread consumer([&] {
+            assert(q.pop_front_wait() == 13);
+        });
+        std::this_thread::sleep_for(milliseconds(10));
+        assert(q.push_back(13) == true);
+        consumer.join();
+        assert(q.pop_front_wait_for(milliseconds(10)) == 0);
+        
+        // without coalescing every push writes
+        qtype_naive qn(16);
+        for (int i = 1; i <= 10; i++) {
+            assert(qn.push_back(i) == true);
+        }
+        assert(qn.notify_back.signals == 10);
+    }
+#endif
+    
+    void test_try_pop()
+    {
+        // try_pop distinguishes a zero item from an empty queue
+        queue_atomic<int> q(4);
+        int v = -1;
+        assert(q.try_pop(v) == queue_empty);
+        assert(q.try_push(0) == queue_ok);
+        assert(q.try_pop(v) == queue_ok);
+        assert(v == 0);
+        for (int i = 0; i < 4; i++) {
+            assert(q.try_push(i) == queue_ok);
+        }
+        assert(q.try_push(4) == queue_full);
+        for (int i = 0; i < 4; i++) {
+            assert(q.try_pop(v) == queue_ok);
+            assert(v == i);
+        }
+        assert(q.try_pop(v) == queue_empty);
+        
+        // move-only items with raw storage
+        typedef std::unique_ptr<int> item_ptr;
+        typedef queue_atomic_storage<item_ptr,queue_storage_raw> qtype;
+        qtype qp(4);
+        assert(qp.emplace_back(new int(1)) == queue_ok);
+        assert(qp.push_back(item_ptr(new int(2))) == true);
+        item_ptr p;
+        assert(qp.try_pop(p) == queue_ok);
+        assert(*p == 1);
+        assert(qp.try_pop(p) == queue_ok);
+        assert(*p == 2);
+        assert(qp.try_pop(p) == queue_empty);
+        
+        // move-only items with per-slot sequence numbers
+        queue_atomic_seq<item_ptr> qs(4);
+        assert(qs.emplace_back(new int(3)) == queue_ok);
+        assert(qs.try_pop(p) == queue_ok);
+        assert(*p == 3);
+        assert(qs.try_pop(p) == queue_empty);
+    }
+    
+    void test_stats()
+    {
+        // stats are empty with the default policy and counted with debug_contention
+        queue_atomic<int> qn(4);
+        assert(qn.push_back(1) == true);
+        assert(qn.stats.snapshot().attempts == 0);
+        
+        queue_atomic<int,true> q(4);
+        for (int i = 1; i <= 4; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.push_back(5) == false);
+        for (int i = 1; i <= 4; i++) {
+            assert(q.pop_front() == i);
+        }
+        queue_stats_snapshot s = q.stats.snapshot();
+        assert(s.attempts == 9);
+        assert(s.retries == 0);
+        assert(s.phase1_failures == 0 && s.phase2_failures == 0);
+        assert(s.spin_limit_exhausted == 0);
+        assert(s.retry_hist[0] == 9);
+        u64 cycle_count = 0;
+        for (int b = 0; b < queue_stats_snapshot::hist_buckets; b++) {
+            cycle_count += s.cycle_hist[b];
+        }
+        assert(cycle_count == 9);
+        assert(queue_stats_snapshot::bucket(0) == 0);
+        assert(queue_stats_snapshot::bucket(1) == 1);
+        assert(queue_stats_snapshot::bucket(4) == 3);
+        assert(queue_stats_snapshot::bucket(~0ULL) == queue_stats_snapshot::hist_buckets - 1);
+    }
+    
+    void test_push_pop_sharded()
+    {
+        const size_t lanes = 4, qsize = 16;
+        queue_sharded<int> q(qsize, lanes);
+        assert(q.capacity() == qsize);
+        
+        // each lane starts on its own cache line
+        for (size_t i = 0; i < lanes; i++) {
+            assert(((uintptr_t)q.lanes[i] & 63) == 0);
+        }
+        
+        // pushes fill the home lane then spill to the other lanes
+        for (int i = 1; i <= (int)qsize; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.size() == qsize);
+        assert(q.push_back(17) == false);
+        size_t home = q.home_lane();
+        assert(q.lanes[home]->size() == qsize / lanes);
+        
+        // the home lane drains first in fifo order, then the other lanes are stolen from
+        int v = 0, sum = 0;
+        for (int i = 1; i <= (int)(qsize / lanes); i++) {
+            assert(q.try_pop(v) == queue_ok);
+            assert(v == i);
+            sum += v;
+        }
+        while (q.try_pop(v) == queue_ok) {
+            sum += v;
+        }
+        assert(sum == (int)(qsize * (qsize + 1) / 2));
+        assert(q.empty() == true);
+        assert(q.pop_front() == 0);
+    }
+    
+    void test_push_pop_segmented()
+    {
+        typedef queue_segmented<int> qtype;
+        qtype q(4, 4);
+        int v = 0;
+        assert(q.empty() == true);
+        assert(q.try_pop(v) == queue_empty);
+        
+        // pushes never fail, segments are linked as the tail fills up
+        for (int i = 1; i <= 10; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.size() == 10);
+        assert(q.head.load() != q.tail.load());
+        assert(((uintptr_t)q.head.load() & 63) == 0);
+        assert(((uintptr_t)q.tail.load() & 63) == 0);
+        
+        // pops are fifo across segments and drained segments go back to the pool
+        for (int i = 1; i <= 10; i++) {
+            assert(q.try_pop(v) == queue_ok && v == i);
+        }
+        assert(q.try_pop(v) == queue_empty);
+        assert(q.empty() == true);
+        assert(q.pool.size() == 2);
+        assert(q.segments == 3);
+        
+        // new segments come from the pool
+        for (int i = 1; i <= 12; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.pool.size() == 0);
+        assert(q.segments == 4);
+        
+        // push_back fails only when max_segments are in use
+        for (int i = 13; i <= 14; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.push_back(15) == false);
+        int sum = 0;
+        while (q.try_pop(v) == queue_ok) sum += v;
+        assert(sum == 105);
+        assert(q.pop_front() == 0);
+        
+        // spare segments are freed by shrink
+        q.shrink();
+        assert(q.pool.size() == 0);
+        assert(q.segments == 1);
+    }
+    
+    void test_combining()
+    {
+        typedef queue_combining<int> qtype;
+        qtype q(4);
+        int v = 0;
+        assert(q.empty() == true);
+        assert(q.try_pop(v) == queue_empty);
+        
+        // requests are applied by the calling thread when no other thread is combining
+        for (int i = 1; i <= 4; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.size() == 4);
+        assert(q.try_push(5) == queue_full);
+        for (int i = 1; i <= 4; i++) {
+            assert(q.try_pop(v) == queue_ok && v == i);
+        }
+        assert(q.pop_front() == 0);
+        
+        // every record is free again once its request is done
+        for (int i = 0; i < q.record_limit; i++) {
+            assert(q.records[i].state == qtype::record_free);
+        }
+        
+        // concurrent requests are batched by whichever thread holds the combiner flag
+        const int nthreads = 8, per_thread = 1024;
+        qtype qc(nthreads * per_thread);
+        std::vector<std::thread> threads;
+        std::atomic<int> sum(0);
+        for (int t = 0; t < nthreads; t++) {
+            threads.push_back(std::thread([&, t] {
+                for (int i = 1; i <= per_thread; i++) {
+                    while (!qc.push_back(t * per_thread + i)) std::this_thread::yield();
+                    int item;
+                    while (qc.try_pop(item) != queue_ok) std::this_thread::yield();
+                    sum += item;
+                }
+            }));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        assert(qc.empty() == true);
+        assert(sum == nthreads * per_thread * (nthreads * per_thread + 1) / 2);
+    }
+    
+    void test_work_stealing()
+    {
+        queue_work_stealing<intptr_t> q(4);
+        intptr_t v;
+        assert(q.pop_bottom(v) == queue_empty);
+        assert(q.steal(v) == queue_empty);
+        
+        // the owner pops newest first, thieves steal oldest first; the buffer grows past 4
+        for (intptr_t i = 1; i <= 10; i++) {
+            q.push_bottom(i);
+        }
+        assert(q.capacity() == 16);
+        assert(q.size() == 10);
+        assert(q.steal(v) == queue_ok && v == 1);
+        assert(q.steal(v) == queue_ok && v == 2);
+        assert(q.pop_bottom(v) == queue_ok && v == 10);
+        assert(q.pop_bottom(v) == queue_ok && v == 9);
+        for (intptr_t i = 3; i <= 8; i++) {
+            assert(q.steal(v) == queue_ok && v == i);
+        }
+        assert(q.pop_bottom(v) == queue_empty);
+        assert(q.steal(v) == queue_empty);
+        assert(q.empty() == true);
+    }
+    
+    void test_work_stealing_stress()
+    {
+        const size_t num_items = 1 << 18, num_thieves = 3;
+        queue_work_stealing<intptr_t> q(64);
+        std::vector<std::atomic<uint8_t>> seen(num_items + 1);
+        std::atomic<bool> done(false);
+        std::atomic<size_t> stolen(0);
+        for (auto &s : seen) s = 0;
+        
+        std::vector<std::thread> thieves;
+        for (size_t i = 0; i < num_thieves; i++) {
+            thieves.push_back(std::thread([&] {
+                intptr_t v;
+                size_t count = 0;
+                while (!done.load(std::memory_order_acquire) || !q.empty()) {
+                    if (q.steal(v) == queue_ok) {
+                        seen[v].fetch_add(1, std::memory_order_relaxed);
+                        count++;
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+                stolen.fetch_add(count);
+            }));
+        }
+        
+        // the owner pushes in bursts and pops part of each burst back
+        size_t popped = 0;
+        intptr_t next = 1, v;
+        while (next <= (intptr_t)num_items) {
+            for (int i = 0; i < 64 && next <= (intptr_t)num_items; i++) {
+                q.push_bottom(next++);
+            }
+            for (int i = 0; i < 16 && q.pop_bottom(v) == queue_ok; i++) {
+                seen[v].fetch_add(1, std::memory_order_relaxed);
+                popped++;
+            }
+        }
+        while (q.pop_bottom(v) == queue_ok) {
+            seen[v].fetch_add(1, std::memory_order_relaxed);
+            popped++;
+        }
+        done.store(true, std::memory_order_release);
+        for (auto &thread : thieves) {
+            thread.join();
+        }
+        
+        // every item is consumed exactly once
+        assert(popped + stolen == num_items);
+        for (size_t i = 1; i <= num_items; i++) {
+            assert(seen[i] == 1);
+        }
+    }
+    
+    void test_executor()
+    {
+        std::atomic<size_t> count(0);
+        {
+            queue_executor<> executor(4, 64);
+            assert(executor.num_workers() == 4);
+            
+            // callables and batches of tasks, more than the queue holds at once
+            auto increment = [&count] { count.fetch_add(1); };
+            for (size_t i = 0; i < 100; i++) {
+                executor.submit(increment);
+            }
+            std::vector<test_count_task> tasks(200, test_count_task(count));
+            std::vector<queue_task*> ptrs;
+            for (auto &task : tasks) {
+                ptrs.push_back(&task);
+            }
+            executor.submit_n(ptrs.data(), ptrs.size());
+            executor.drain();
+            assert(count == 300);
+            
+            // drain parks instead of spinning while a slow task runs
+            struct timespec c1, c2;
+            executor.submit([] { std::this_thread::sleep_for(milliseconds(100)); });
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c1);
+            executor.drain();
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c2);
+            uint64_t cpu_time_us = (c2.tv_sec - c1.tv_sec) * 1000000 + (c2.tv_nsec - c1.tv_nsec) / 1000;
+            assert(cpu_time_us < 20000);
+            
+            // tasks still queued at shutdown are run before the workers stop
+            for (size_t i = 0; i < 50; i++) {
+                executor.submit([&count] { std::this_thread::yield(); count.fetch_add(1); });
+            }
+            executor.shutdown();
+            assert(count == 350);
+        }
+    }
+    
+    void test_broadcast()
+    {
+        queue_broadcast<int> q(4, 4);
+        
+        // consumers are constructed inactive, each cursor on its own cache line
+        for (size_t i = 0; i < 4; i++) {
+            assert(((uintptr_t)&q.consumers[i].cursor & 63) == 0);
+            assert(q.consumers[i].active.load() == false);
+        }
+        int a = q.subscribe(), b = q.subscribe();
+        assert(a >= 0 && b >= 0 && a != b);
+        int v, out[8];
+        
+        // the producer is gated on the slowest consumer
+        for (int i = 1; i <= 4; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.push_back(5) == false);
+        assert(q.pop_front_n(a, out, 8) == 4);
+        assert(out[0] == 1 && out[3] == 4);
+        assert(q.push_back(5) == false);
+        assert(q.try_pop(b, v) == queue_ok && v == 1);
+        assert(q.push_back(5) == true);
+        assert(q.push_back(6) == false);
+        
+        // every consumer sees every item, batch reads wrap around the ring
+        assert(q.pop_front_n(b, out, 8) == 4);
+        assert(out[0] == 2 && out[3] == 5);
+        assert(q.try_pop(a, v) == queue_ok && v == 5);
+        assert(q.try_pop(a, v) == queue_empty);
+        int in[3] = { 6, 7, 8 };
+        assert(q.push_back_n(in, 3) == 3);
+        
+        // a late subscriber starts at the current cursor and does not gate older items
+        int c = q.subscribe();
+        assert(q.size(c) == 0);
+        assert(q.size(a) == 3);
+        q.unsubscribe(c);
+        assert(q.pop_front_n(a, out, 8) == 3 && out[2] == 8);
+        assert(q.pop_front_n(b, out, 8) == 3 && out[0] == 6);
+        assert(q.empty(a) && q.empty(b));
+    }
+    
+    void test_broadcast_subscribe()
+    {
+        queue_broadcast<int> q(16, 4);
+        std::atomic<bool> stop(false);
+        
+        // the producer runs free between subscriptions and must never lap a new consumer
+        std::thread producer([&] {
+            int next = 1;
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (q.push_back(next)) next++;
+                else std::this_thread::yield();
+            }
+        });
+        for (int round = 0; round < 1000; round++) {
+            int id = q.subscribe();
+            int v = 0, last = 0;
+            for (int read = 0; read < 64; ) {
+                if (q.try_pop(id, v) != queue_ok) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                assert(last == 0 || v == last + 1);
+                last = v;
+                read++;
+            }
+            q.unsubscribe(id);
+        }
+        stop = true;
+        producer.join();
+    }
+    
+    void test_overwrite()
+    {
+        typedef queue_atomic_overflow<int,queue_overflow_overwrite> qtype;
+        qtype q(4);
+        uint64_t seen = 0;
+        int v = 0;
+        
+        // pushes onto a full queue drop the oldest item instead of failing
+        for (int i = 1; i <= 10; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.size() == 4);
+        assert(q.dropped() == 6);
+        assert(q.lapped(seen) == 6);
+        assert(q.lapped(seen) == 0);
+        
+        // consumers continue from the oldest item still in the queue
+        int out[2];
+        assert(q.pop_front_n(out, 2) == 2);
+        assert(out[0] == 7 && out[1] == 8);
+        int in[3] = { 11, 12, 13 };
+        assert(q.push_back_n(in, 3) == 3);
+        assert(q.lapped(seen) == 1);
+        for (int i = 10; i <= 13; i++) {
+            assert(q.try_pop(v) == queue_ok && v == i);
+        }
+        assert(q.try_pop(v) == queue_empty);
+        
+        // push_back_wait drops the oldest item instead of parking on a full queue
+        for (int i = 1; i <= 4; i++) {
+            assert(q.push_back(i) == true);
+        }
+        uint64_t dropped = q.dropped();
+        assert(q.push_back_wait(5) == true);
+        assert(q.push_back_wait_for(6, milliseconds(10)) == true);
+        assert(q.dropped() == dropped + 2);
+        for (int i = 3; i <= 6; i++) {
+            assert(q.try_pop(v) == queue_ok && v == i);
+        }
+        
+        // the default policy still rejects
+        queue_atomic<int> r(4);
+        for (int i = 1; i <= 4; i++) {
+            assert(r.push_back(i) == true);
+        }
+        assert(r.try_push(5) == queue_full);
+    }
+    
+    void test_reserve_commit()
+    {
+        const size_t qsize = 4;
+        typedef test_frame<64> frame_type;
+        typedef queue_atomic_storage<frame_type,queue_storage_raw> qtype;
+        qtype q(qsize);
+        
+        // reserve_back claims slots to be written in place
+        qtype::slot_span span = q.reserve_back(3);
+        assert(span.size() == 3);
+        assert(span.second_count == 0);
+        assert(q.size() == 0);
+        for (size_t i = 0; i < 3; i++) {
+            span[i].seq = i + 1;
+        }
+        q.commit(span);
+        assert(q._back_version() == 1);
+        assert(q.size() == 3);
+        
+        // peek_front claims slots to be read in place
+        span = q.peek_front(2);
+        assert(span.size() == 2);
+        assert(span[0].seq == 1);
+        assert(span[1].seq == 2);
+        q.release(span);
+        assert(q._front_version() == 1);
+        assert(q.size() == 1);
+        
+        // reserve_back clamps to free space and splits at the wrap-around point
+        span = q.reserve_back(4);
+        assert(span.size() == 3);
+        assert(span.first_count == 1);
+        assert(span.second_count == 2);
+        assert(span.second == q.vec);
+        for (size_t i = 0; i < 3; i++) {
+            span[i].seq = i + 4;
+        }
+        q.commit(span);
+        assert(q.full() == true);
+        assert(!q.reserve_back());
+        
+        span = q.peek_front(4);
+        assert(span.size() == 4);
+        for (size_t i = 0; i < 4; i++) {
+            assert(span[i].seq == i + 3);
+        }
+        q.release(span);
+        assert(q.empty() == true);
+        assert(!q.peek_front());
+        
+        // empty reservations claim nothing and need no commit or release
+        assert(!q.reserve_back(0));
+        assert(q.push_back(frame_type()) == true);
+        assert(!q.peek_front(0));
+        span = q.peek_front();
+        assert(span.size() == 1);
+        q.release(span);
+        span = q.reserve_back();
+        assert(span.size() == 1);
+        q.commit(span);
+        assert(q.size() == 1);
+    }
+    
+    void test_consume_all()
+    {
+        const size_t qsize = 8;
+        typedef queue_atomic_storage<int,queue_storage_raw> qtype;
+        qtype q(qsize);
+        std::vector<int> seen;
+        size_t runs = 0;
+        auto collect = [&](int *first, size_t count) {
+            seen.insert(seen.end(), first, first + count);
+            runs++;
+        };
+        
+        // an empty queue makes no call
+        assert(q.consume_all(collect) == 0);
+        assert(runs == 0);
+        
+        // everything published is consumed in one contiguous run
+        for (int i = 1; i <= 5; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.consume_all(collect) == 5);
+        assert(runs == 1);
+        assert(q._front_version() == 1);
+        assert(q.empty() == true);
+        
+        // max clamps the claim and wrap-around splits it into two runs
+        for (int i = 6; i <= 13; i++) {
+            assert(q.push_back(i) == true);
+        }
+        assert(q.consume_all(collect, 2) == 2);
+        assert(runs == 2);
+        assert(q.consume_all(collect) == 6);
+        assert(runs == 4);
+        assert(q.empty() == true);
+        assert(seen.size() == 13);
+        for (int i = 1; i <= 13; i++) {
+            assert(seen[i - 1] == i);
+        }
+        
+        // a zero max makes no call and leaves the queue usable
+        assert(q.push_back(42) == true);
+        assert(q.consume_all(collect, 0) == 0);
+        assert(runs == 4);
+        assert(q.size() == 1);
+        assert(q.consume_all(collect) == 1);
+        assert(seen.back() == 42);
+        
+        // a throwing callback still releases the claimed span
+        assert(q.push_back(43) == true);
+        bool threw = false;
+        try {
+            q.consume_all([](int *, size_t) { throw 1; });
+        } catch (int) {
+            threw = true;
+        }
+        assert(threw == true);
+        assert(q.empty() == true);
+        assert(q.push_back(44) == true);
+        assert(q.pop_front() == 44);
+        
+        // the default storage passes std::atomic<T> slots
+        queue_atomic<int> a(qsize);
+        int sum = 0;
+        for (int i = 1; i <= 4; i++) {
+            assert(a.push_back(i) == true);
+        }
+        assert(a.consume_all([&](std::atomic<int> *first, size_t count) {
+            for (size_t i = 0; i < count; i++) sum += first[i].load(std::memory_order_relaxed);
+        }) == 4);
+        assert(sum == 10);
+        assert(a.empty() == true);
+    }
+    
+    void test_push_pop_single_queue_mutex()
+    {
+        test_push_pop_single<int,queue_std_mutex<int>>("queue_std_mutex", 8388608);
+    }
+    
+    void test_push_pop_single_queue_atomic()
+    {
+        test_push_pop_single<int,queue_atomic<int>>("queue_atomic", 8388608);
+    }
+
+    void test_push_pop_single_queue_atomic_u128()
+    {
+#if QUEUE_HAS_UINT128
+        test_push_pop_single<int,queue_atomic<int,false,queue_uint128_t,64,32>>("queue_atomic:u128", 8388608);
+#endif
+    }
+
+    void test_push_pop_single_queue_atomic_seq()
+    {
+        test_push_pop_single<int,queue_atomic_seq<int>>("queue_atomic_seq", 8388608);
+    }
+
+    void test_push_pop_single_queue_atomic_spsc()
+    {
+        test_push_pop_single<int,queue_atomic_cardinality<int,queue_spsc>>("queue_atomic:spsc", 8388608);
+    }
+
+    void test_push_pop_single_queue_atomic_futex()
+    {
+        test_push_pop_single<int,queue_atomic<int,false,uint64_t,48,16,
+            std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+            queue_notify_futex>>("queue_atomic:futex", 8388608);
+    }
+
+    void test_pop_wait_idle_queue_atomic()
+    {
+        test_pop_wait_idle<int,queue_atomic<int>>("queue_atomic", 100);
+        test_pop_wait_idle<int,queue_atomic<int,false,uint64_t,48,16,
+            std::memory_order_relaxed,std::memory_order_acquire,std::memory_order_release,
+            queue_notify_futex>>("queue_atomic:futex", 100);
+#if defined(__linux__)
+        test_pop_wait_idle<int,queue_atomic_policy<int,queue_notify_eventfd<>,
+            queue_backoff_spin_yield<>>>("queue_atomic:eventfd", 100);
+#endif
+    }
+
+    void test_frame_queue_atomic()
+    {
+        typedef test_frame<256> frame_type;
+        typedef queue_atomic_storage<frame_type,queue_storage_raw> qtype;
+        test_frame_copy<frame_type,qtype>("queue_atomic:copy", 8388608, 1024);
+        test_frame_inplace<frame_type,qtype>("queue_atomic:inplace", 8388608, 1024);
+    }
+
+    template <size_t N>
+    void test_payload_queue_atomic(const size_t num_items)
+    {
+        typedef test_frame<N> frame_type;
+        test_payload_single<frame_type,queue_atomic_storage<frame_type,queue_storage_atomic>>("queue_atomic:atomic", num_items);
+        test_payload_single<frame_type,queue_atomic_storage<frame_type,queue_storage_inline>>("queue_atomic:inline", num_items);
+    }
+
+    void test_payload_queue_atomic()
+    {
+        test_payload_queue_atomic<8>(1048576);
+        test_payload_queue_atomic<32>(1048576);
+        test_payload_queue_atomic<64>(1048576);
+        test_payload_queue_atomic<256>(1048576);
+    }
+
+    void test_push_pop_single_queue_atomic_pages()
+    {
+        const size_t num_items = 8388608;
+        test_push_pop_single<int,queue_atomic<int>>("queue_atomic:heap", num_items);
+        test_push_pop_single<int,queue_atomic_alloc<int,queue_alloc_mmap<queue_pages_small>>>("queue_atomic:4k", num_items);
+        test_push_pop_single<int,queue_atomic_alloc<int,queue_alloc_mmap<queue_pages_transparent>>>("queue_atomic:thp", num_items);
+        test_push_pop_single<int,queue_atomic_alloc<int,queue_alloc_mmap<queue_pages_huge>>>("queue_atomic:hugetlb", num_items);
+    }
+    
+    void test_transfer_threads_queue_atomic_pages()
+    {
+        const size_t num_items = 8388608;
+        test_transfer_threads<int,queue_atomic<int>>("queue_atomic:heap", 2, 2, num_items / 2, num_items);
+        test_transfer_threads<int,queue_atomic_alloc<int,queue_alloc_mmap<queue_pages_small>>>("queue_atomic:4k", 2, 2, num_items / 2, num_items);
+        test_transfer_threads<int,queue_atomic_alloc<int,queue_alloc_mmap<queue_pages_transparent>>>("queue_atomic:thp", 2, 2, num_items / 2, num_items);
+        test_transfer_threads<int,queue_atomic_alloc<int,queue_alloc_mmap<queue_pages_huge>>>("queue_atomic:hugetlb", 2, 2, num_items / 2, num_items);
+    }
+    
+    void test_drain_queue_atomic()
+    {
+        typedef queue_atomic_storage<int,queue_storage_raw> qtype;
+        for (size_t burst : { 8, 64, 512 }) {
+            test_drain<int,qtype>("pop_front", 8388608, burst, false);
+            test_drain<int,qtype>("consume_all", 8388608, burst, true);
+        }
+    }
+    
+    void test_push_pop_batch_queue_atomic()
+    {
+        test_push_pop_batch<int,queue_atomic<int>>("queue_atomic", 8388608, 1);
+        test_push_pop_batch<int,queue_atomic<int>>("queue_atomic", 8388608, 8);
+        test_push_pop_batch<int,queue_atomic<int>>("queue_atomic", 8388608, 64);
+        test_push_pop_batch<int,queue_atomic<int>>("queue_atomic", 8388608, 512);
+    }
+
+    void test_push_pop_threads_queue_mutex()
+    {
+        test_push_pop_threads<int,queue_std_mutex<int>>("queue_std_mutex", 8, 10, 1024);
+    }
+
+    void test_push_pop_threads_queue_atomic()
+    {
+        test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 10, 1024);
+        test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 10, 1024);
+        test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 10, 65536);
+        test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 10, 65536);
         test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 64, 65536);
         test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 64, 65536);
         test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 16, 262144);
         test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 8, 16, 262144);
     }
 
+    template <typename Notify, typename Backoff>
+    void test_push_pop_threads_queue_atomic_backoff(const char *name)
+    {
+        test_push_pop_threads<int,queue_atomic_policy<int,Notify,Backoff>>(name, 2, 10, 16384);
+        test_push_pop_threads<int,queue_atomic_policy<int,Notify,Backoff>>(name, 8, 10, 4096);
+        test_push_pop_threads<int,queue_atomic_policy<int,Notify,Backoff>>(name, 32, 10, 1024);
+    }
+
+    void test_push_pop_threads_queue_atomic_backoff()
+    {
+        test_push_pop_threads_queue_atomic_backoff<queue_notify_none,
+            queue_backoff_yield>("queue_atomic:yield");
+        test_push_pop_threads_queue_atomic_backoff<queue_notify_none,
+            queue_backoff_spin>("queue_atomic:spin");
+        test_push_pop_threads_queue_atomic_backoff<queue_notify_none,
+            queue_backoff_exponential<>>("queue_atomic:expo");
+        test_push_pop_threads_queue_atomic_backoff<queue_notify_none,
+            queue_backoff_spin_yield<>>("queue_atomic:spinyield");
+        test_push_pop_threads_queue_atomic_backoff<queue_notify_futex,
+            queue_backoff_spin_park<>>("queue_atomic:spinpark");
+    }
+
+    void test_transfer_threads_queue_atomic_cardinality()
+    {
+        test_transfer_threads<int,queue_atomic<int>>("queue_atomic", 1, 1, 1048576, 1024);
+        test_transfer_threads<int,queue_atomic_cardinality<int,queue_spsc>>("queue_atomic:spsc", 1, 1, 1048576, 1024);
+        test_transfer_threads<int,queue_atomic<int>>("queue_atomic", 4, 1, 262144, 1024);
+        test_transfer_threads<int,queue_atomic_cardinality<int,queue_mpsc>>("queue_atomic:mpsc", 4, 1, 262144, 1024);
+        test_transfer_threads<int,queue_atomic<int>>("queue_atomic", 1, 4, 1048576, 1024);
+        test_transfer_threads<int,queue_atomic_cardinality<int,queue_spmc>>("queue_atomic:spmc", 1, 4, 1048576, 1024);
+    }
+
+    void test_push_pop_threads_queue_atomic_u128()
+    {
+#if QUEUE_HAS_UINT128
+        typedef queue_atomic<int,false,queue_uint128_t,64,32> qtype;
+        test_push_pop_threads<int,qtype>("queue_atomic:u128", 8, 10, 1024);
+        test_push_pop_threads<int,qtype>("queue_atomic:u128", 8, 10, 65536);
+        test_push_pop_threads<int,qtype>("queue_atomic:u128", 8, 16, 262144);
+        test_push_pop_threads<int,qtype>("queue_atomic:u128", 32, 10, 1024);
+#endif
+    }
+
+    void test_push_pop_threads_queue_atomic_seq()
+    {
+        test_push_pop_threads<int,queue_atomic_seq<int>>("queue_atomic_seq", 8, 10, 1024);
+        test_push_pop_threads<int,queue_atomic_seq<int>>("queue_atomic_seq", 8, 10, 65536);
+        test_push_pop_threads<int,queue_atomic_seq<int>>("queue_atomic_seq", 8, 16, 262144);
+        test_push_pop_threads<int,queue_atomic_seq<int>>("queue_atomic_seq", 32, 10, 1024);
+        test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", 32, 10, 1024);
+    }
+
+    void test_transfer_threads_queue_sharded()
+    {
+        const size_t num_items = 1 << 20;
+        for (size_t nthreads : { 8, 32, 64 }) {
+            size_t half = nthreads / 2;
+            test_transfer_threads<int,queue_atomic<int>>("queue_atomic", half, half, num_items / half, 65536);
+            test_transfer_threads<int,queue_sharded<int>>("queue_sharded:8", half, half, num_items / half, 65536);
+        }
+    }
+    
+    void test_transfer_threads_queue_segmented()
+    {
+        const size_t num_items = 1 << 20;
+        for (size_t nthreads : { 2, 8 }) {
+            size_t half = nthreads / 2;
+            test_transfer_threads<int,queue_atomic<int>>("queue_atomic", half, half, num_items / half, num_items);
+            test_transfer_threads<int,queue_segmented<int>>("queue_segmented", half, half, num_items / half, 1024);
+        }
+    }
+    
+    void test_push_pop_threads_queue_combining()
+    {
+        for (size_t nthreads : { 4, 16, 32, 64 }) {
+            test_push_pop_threads<int,queue_std_mutex<int>>("queue_std_mutex", nthreads, 10, 1024);
+            test_push_pop_threads<int,queue_atomic<int>>("queue_atomic", nthreads, 10, 1024);
+            test_push_pop_threads<int,queue_combining<int>>("queue_combining", nthreads, 10, 1024);
+        }
+    }
+    
+    void test_transfer_threads_queue_atomic_layout()
+    {
+        const size_t num_items = 1 << 20;
+        test_transfer_threads<int,queue_atomic_layout<int,queue_spsc,queue_layout_linear>>("linear:spsc", 1, 1, num_items, 1024);
+        test_transfer_threads<int,queue_atomic_layout<int,queue_spsc,queue_layout_rotate<>>>("rotate:spsc", 1, 1, num_items, 1024);
+        test_transfer_threads<int,queue_atomic_layout<int,queue_spsc,queue_layout_padded<>>>("padded:spsc", 1, 1, num_items, 1024);
+        test_transfer_threads<int,queue_atomic_layout<int,queue_mpmc,queue_layout_linear>>("linear:mpmc", 2, 2, num_items / 2, 1024);
+        test_transfer_threads<int,queue_atomic_layout<int,queue_mpmc,queue_layout_rotate<>>>("rotate:mpmc", 2, 2, num_items / 2, 1024);
+        test_transfer_threads<int,queue_atomic_layout<int,queue_mpmc,queue_layout_padded<>>>("padded:mpmc", 2, 2, num_items / 2, 1024);
+    }
+    
+    void test_executor_tasks_queue_atomic()
+    {
+        test_executor_tasks("queue_executor", 4, 65536, 1);
+        test_executor_tasks("queue_executor", 4, 65536, 64);
+        test_executor_tasks("queue_executor", 16, 65536, 64);
+        test_async_tasks("std::async", 8192);
+    }
+    
+    void test_fanout_queue_broadcast()
+    {
+        for (size_t consumers : { 4, 8, 12 }) {
+            test_fanout_copies<u64>("queue_atomic:copies", consumers, 1 << 18);
+            test_fanout_broadcast<u64>("queue_broadcast", consumers, 1 << 18, 64);
+        }
+    }
+    
+    void test_overwrite_queue_atomic()
+    {
+        test_overwrite_push<int,queue_atomic<int>>("queue_atomic:pop", 1024, 1 << 20);
+        test_overwrite_push<int,queue_atomic_overflow<int,queue_overflow_overwrite>>("queue_atomic:overwrite", 1024, 1 << 20);
+    }
+    
+#if defined(__linux__)
+    void test_ipc_queue_shm()
+    {
+        const size_t num_items = 262144;
+        test_ipc_shm<u64>("queue_shm", num_items);
+        test_ipc_stream<u64>("pipe", num_items, 1, false);
+        test_ipc_stream<u64>("pipe:64", num_items, 64, false);
+        test_ipc_stream<u64>("unix_socket", num_items, 1, true);
+        test_ipc_stream<u64>("unix_socket:64", num_items, 64, true);
+    }
+#endif
+    
+#if defined(__linux__)
+    void test_notify_epoll_queue_atomic()
+    {
+        typedef queue_atomic_policy<u64,queue_notify_eventfd<>,queue_backoff_spin_yield<>,queue_spsc> qtype;
+        typedef queue_atomic_policy<u64,queue_notify_eventfd<false>,queue_backoff_spin_yield<>,queue_spsc> qtype_naive;
+        for (size_t burst : { 1, 64, 1024 }) {
+            test_notify_epoll<qtype_naive>("eventfd:per-push", 1000, burst);
+            test_notify_epoll<qtype>("eventfd:coalesced", 1000, burst);
+        }
+    }
+#endif
+    
     void test_push_pop_threads_queue_atomic_contention()
     {
         test_push_pop_threads<int,queue_atomic<int,true>>("queue_atomic:contention", 1, 10, 65536);
         test_push_pop_threads<int,queue_atomic<int,true>>("queue_atomic:contention", 8, 1, 256);
     }
+    
+    void test_contention_stats_queue_atomic()
+    {
+        test_contention_stats<int,queue_atomic<int,true>>("queue_atomic:stats", 1, 10, 65536);
+        test_contention_stats<int,queue_atomic<int,true>>("queue_atomic:stats", 8, 10, 4096);
+        test_contention_stats<int,queue_atomic<int,true>>("queue_atomic:stats", 32, 10, 1024);
+    }
 };
 
 int main(int argc, const char * argv[])
 {
     test_queue tq;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--perf") == 0) perf.open();
+    }
     printf("# unit-tests\n");
     tq.test_queue_constants();
+#if QUEUE_HAS_UINT128
+    tq.test_queue_constants_u128();
+    tq.test_push_pop_u128();
+#endif
     tq.test_empty_invariants();
     tq.test_push_pop();
+    tq.test_push_pop_n();
+    tq.test_push_pop_wait();
+#if defined(__linux__)
+    tq.test_notify_eventfd();
+#endif
+    tq.test_push_pop_spsc();
+    tq.test_push_pop_seq();
+    tq.test_reserve_commit();
+    tq.test_consume_all();
+    tq.test_storage_inline();
+    tq.test_storage_alloc();
+    tq.test_layout();
+#if defined(__linux__)
+    tq.test_shm();
+#endif
+    tq.test_try_pop();
+    tq.test_stats();
+    tq.test_push_pop_sharded();
+    tq.test_push_pop_segmented();
+    tq.test_combining();
+    tq.test_work_stealing();
+    tq.test_work_stealing_stress();
+    tq.test_executor();
+    tq.test_broadcast();
+    tq.test_broadcast_subscribe();
+    tq.test_overwrite();
     printf("# single-thread\n");
     heading_single();
     tq.test_push_pop_single_queue_mutex();
     tq.test_push_pop_single_queue_atomic();
+    tq.test_push_pop_single_queue_atomic_u128();
+    tq.test_push_pop_single_queue_atomic_seq();
+    tq.test_push_pop_single_queue_atomic_spsc();
+    tq.test_push_pop_single_queue_atomic_futex();
+    printf("# batch\n");
+    heading_batch();
+    tq.test_push_pop_batch_queue_atomic();
+    printf("# drain\n");
+    heading_batch();
+    tq.test_drain_queue_atomic();
+    printf("# in-place\n");
+    heading_frame();
+    tq.test_frame_queue_atomic();
+    printf("# payload\n");
+    heading_frame();
+    tq.test_payload_queue_atomic();
+    printf("# huge pages\n");
+    heading_single();
+    tq.test_push_pop_single_queue_atomic_pages();
+    heading_transfer();
+    tq.test_transfer_threads_queue_atomic_pages();
+    printf("# idle wait\n");
+    heading_wait();
+    tq.test_pop_wait_idle_queue_atomic();
     printf("# multi-thread\n");
     heading_multi();
     tq.test_push_pop_threads_queue_mutex();
     tq.test_push_pop_threads_queue_atomic();
+    tq.test_push_pop_threads_queue_atomic_u128();
+    tq.test_push_pop_threads_queue_atomic_seq();
+    printf("# producer/consumer\n");
+    heading_transfer();
+    tq.test_transfer_threads_queue_atomic_cardinality();
+    printf("# sharded\n");
+    heading_transfer();
+    tq.test_transfer_threads_queue_sharded();
+    printf("# layout\n");
+    heading_transfer();
+    tq.test_transfer_threads_queue_atomic_layout();
+    printf("# unbounded\n");
+    heading_transfer();
+    tq.test_transfer_threads_queue_segmented();
+    printf("# combining\n");
+    heading_multi();
+    tq.test_push_pop_threads_queue_combining();
+    printf("# executor\n");
+    heading_executor();
+    tq.test_executor_tasks_queue_atomic();
+    printf("# fan-out\n");
+    heading_fanout();
+    tq.test_fanout_queue_broadcast();
+    printf("# overwrite\n");
+    heading_single();
+    tq.test_overwrite_queue_atomic();
+#if defined(__linux__)
+    printf("# ipc\n");
+    heading_single();
+    tq.test_ipc_queue_shm();
+    printf("# epoll\n");
+    heading_notify();
+    tq.test_notify_epoll_queue_atomic();
+#endif
+    printf("# backoff\n");
+    heading_multi();
+    tq.test_push_pop_threads_queue_atomic_backoff();
     printf("# contention tests\n");
     heading_multi();
     tq.test_push_pop_threads_queue_atomic_contention();
+    heading_stats();
+    tq.test_contention_stats_queue_atomic();
 }
 